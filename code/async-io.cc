@@ -0,0 +1,2006 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ==============================================================================
+// Async file and socket I/O: io_uring, with an epoll fallback
+// ==============================================================================
+// A coroutine that calls pread() or recv() blocks the Loop thread, and with
+// it every other coroutine on the Loop. Here reads and writes are
+// awaitables instead:
+//
+//   std::size_t n = co_await async_read(file, offset, buffer);
+//   co_await async_write(file, offset, data);
+//
+//   Socket client = co_await listener.accept();
+//   std::size_t got = co_await client.read_some(buffer);
+//   co_await client.write_all(reply);
+//
+//   ReceivedBuffer chunk = co_await client.receive();  // from a shared pool
+//
+// The Loop picks a backend when it is created:
+// - io_uring: the awaiter only fills a submission queue entry (SQE); the
+//   Loop submits all pending SQEs with one io_uring_enter() when it runs
+//   out of ready coroutines, and waits in the same call for completions
+//   (CQEs). Each CQE puts its coroutine back on the ready queue.
+// - Epoll: when io_uring is unavailable (old kernel, seccomp, or
+//   kernel.io_uring_disabled). Sockets are non-blocking; an operation that
+//   would block parks its coroutine until epoll reports the fd ready. Regular
+//   files are always "ready" for epoll, so file reads and writes run on a
+//   small fixed thread pool instead, which posts the coroutine back.
+// Either way the coroutine resumes on the Loop thread, never on the kernel's
+// or the pool's.
+//
+// io_uring is set up with the raw syscalls rather than liburing, so the file
+// only needs <linux/io_uring.h>.
+//
+// For many mostly idle connections (see BufferPool) the io_uring backend
+// also uses multishot requests: one multishot accept per listener and one
+// multishot recv per receiving socket stay armed in the kernel, and recv
+// draws its buffers from a provided-buffer ring only once data is there.
+
+// ==============================================================================
+// IoRequest: What an I/O awaiter leaves behind while it is suspended
+// ==============================================================================
+// io_uring carries a pointer to it in the SQE's user_data and hands it back
+// in the CQE. The request lives in the awaiter, i.e. in the suspended
+// coroutine's frame, until the coroutine is resumed.
+//
+// A multishot request (see Multishot) gets a CQE per result instead, with
+// IORING_CQE_F_MORE set on all but the last one. It sets 'on_cqe', which is
+// called for every CQE in place of resuming 'handle'.
+struct IoRequest {
+  std::coroutine_handle<> handle;
+  int result{0};  // >= 0: bytes transferred, < 0: -errno
+  void (*on_cqe)(IoRequest &request, int result, std::uint32_t flags){nullptr};
+};
+
+// ==============================================================================
+// IoUring: Submission and completion rings shared with the kernel
+// ==============================================================================
+// - SQ ring: we fill SQEs and advance the tail; the kernel advances the head
+//   as it consumes them
+// - CQ ring: the kernel writes CQEs and advances the tail; we advance the
+//   head once a CQE is handled
+// The head/tail words are shared memory, so they are accessed through
+// std::atomic_ref: acquire when reading the other side's index, release
+// when publishing ours.
+//
+// CQEs that do not fit into the CQ ring are held back by the kernel until
+// there is space (IORING_FEAT_NODROP, Linux 5.5+), so the number of
+// requests in flight is not limited by the ring size: a server can have a
+// recv pending on every idle connection. Only without NODROP, where extra
+// CQEs would be lost, are one-shot requests capped at the CQ ring size.
+// The CQ ring is made 8x the SQ ring so that bursts of completions, e.g.
+// from multishot requests, rarely need the overflow path.
+struct IoUring {
+  // create(): nullptr when the kernel refuses io_uring
+  static std::unique_ptr<IoUring> create(unsigned entries) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 8;
+    int fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    std::unique_ptr<IoUring> ring(new IoUring);
+    ring->fd = fd;
+    ring->sq_entries = params.sq_entries;
+    ring->cq_entries = params.cq_entries;
+    ring->no_drop = params.features & IORING_FEAT_NODROP;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+    }
+    ring->sq_ptr = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+      ring->sq_ptr = nullptr;
+      return nullptr;
+    }
+    ring->cq_ptr = single_mmap
+                       ? ring->sq_ptr
+                       : mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+      ring->cq_ptr = nullptr;
+      return nullptr;
+    }
+    void *sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return nullptr;
+    }
+    ring->sqes = static_cast<io_uring_sqe *>(sqes);
+
+    auto *sq = static_cast<char *>(ring->sq_ptr);
+    ring->sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring->sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(ring->cq_ptr);
+    ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring->cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    ring->local_tail = *ring->sq_tail;
+    return ring;
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring() {
+    if (sqes) {
+      munmap(sqes, sq_entries * sizeof(io_uring_sqe));
+    }
+    if (cq_ptr && cq_ptr != sq_ptr) {
+      munmap(cq_ptr, cq_size);
+    }
+    if (sq_ptr) {
+      munmap(sq_ptr, sq_size);
+    }
+    close(fd);
+  }
+
+  // has_room(): An SQE is free and a one-shot CQE cannot be lost
+  bool has_room() const { return !sq_full() && (no_drop || in_flight < cq_entries); }
+
+  // sq_full(): Every SQE is filled; a submit frees them, no CQE needed
+  bool sq_full() const {
+    unsigned head = std::atomic_ref(*sq_head).load(std::memory_order_acquire);
+    return local_tail - head >= sq_entries;
+  }
+
+  // next_sqe(): A zeroed SQE for 'request'; the caller checks has_room()
+  io_uring_sqe &next_sqe(IoRequest &request) {
+    unsigned index = local_tail & sq_mask;
+    io_uring_sqe &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.user_data = reinterpret_cast<std::uint64_t>(&request);
+    sq_array[index] = index;
+    ++local_tail;
+    if (!request.on_cqe) {
+      ++in_flight;
+    }
+    return sqe;
+  }
+
+  // submit_and_wait(): Publish the new SQEs and, if 'wait' > 0, block until
+  // at least that many CQEs are available
+  // - EBUSY: older kernels refuse new SQEs while CQEs sit in the overflow
+  //   list; the caller reaps, and the SQEs go with the next call
+  void submit_and_wait(unsigned wait) {
+    std::atomic_ref(*sq_tail).store(local_tail, std::memory_order_release);
+    unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+      // Whatever the kernel has not consumed yet, also after an EINTR
+      unsigned head = std::atomic_ref(*sq_head).load(std::memory_order_acquire);
+      if (syscall(__NR_io_uring_enter, fd, local_tail - head, wait, flags, nullptr,
+                  0) >= 0) {
+        return;
+      }
+      if (errno == EBUSY) {
+        return;
+      }
+      if (errno != EINTR) {
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+      }
+    }
+  }
+
+  // reap(): Hand every available CQE to 'complete(request, res, flags)'
+  // - 'complete' must not prepare SQEs; the CQ head is only published after
+  //   the whole batch
+  template <typename F> void reap(F complete) {
+    unsigned head = *cq_head;
+    unsigned tail = std::atomic_ref(*cq_tail).load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes[head & cq_mask];
+      auto *request = reinterpret_cast<IoRequest *>(cqe.user_data);
+      if (!request->on_cqe) {
+        --in_flight;
+      }
+      complete(*request, cqe.res, cqe.flags);
+    }
+    std::atomic_ref(*cq_head).store(head, std::memory_order_release);
+  }
+
+  // register_buffer_ring(): Lend the kernel 'ring' (see BufferPool) as buffer
+  // group 'group'; false on kernels without provided-buffer rings
+  bool register_buffer_ring(io_uring_buf_ring *ring, unsigned entries,
+                            std::uint16_t group) {
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<std::uint64_t>(ring);
+    registration.ring_entries = entries;
+    registration.bgid = group;
+    return syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING,
+                   &registration, 1) == 0;
+  }
+
+  void unregister_buffer_ring(std::uint16_t group) {
+    io_uring_buf_reg registration{};
+    registration.bgid = group;
+    syscall(__NR_io_uring_register, fd, IORING_UNREGISTER_PBUF_RING, &registration,
+            1);
+  }
+
+  // pending(): One-shot requests in flight; multishot ones are tracked by
+  // the Loop
+  std::size_t pending() const { return in_flight; }
+
+private:
+  IoUring() = default;
+
+  int fd{-1};
+  unsigned sq_entries{0};
+  unsigned cq_entries{0};
+  bool no_drop{false};
+  std::size_t sq_size{0};
+  std::size_t cq_size{0};
+  void *sq_ptr{nullptr};
+  void *cq_ptr{nullptr};
+  io_uring_sqe *sqes{nullptr};
+
+  unsigned *sq_head{nullptr};
+  unsigned *sq_tail{nullptr};
+  unsigned *sq_array{nullptr};
+  unsigned sq_mask{0};
+  unsigned *cq_head{nullptr};
+  unsigned *cq_tail{nullptr};
+  unsigned cq_mask{0};
+  io_uring_cqe *cqes{nullptr};
+
+  unsigned local_tail{0};    // SQEs filled, published to sq_tail on submit
+  std::size_t in_flight{0};  // one-shot SQEs whose CQE has not been reaped
+};
+
+// ==============================================================================
+// ThreadPool: Blocking file I/O for the epoll backend
+// ==============================================================================
+struct ThreadPool {
+  explicit ThreadPool(std::size_t threads) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  // ~ThreadPool(): Finishes the queued jobs, then joins the workers
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+  }
+
+  std::size_t size() const { return workers.size(); }
+
+private:
+  void work() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::deque<std::function<void()>> jobs;
+  bool stopping{false};
+  std::vector<std::thread> workers;
+};
+
+// get_io_pool(): Bounded, so a burst of reads queues up instead of
+// starting one thread per request
+ThreadPool &get_io_pool() {
+  static ThreadPool pool(4);
+  return pool;
+}
+
+// ==============================================================================
+// FdWaiters: The coroutines waiting for one fd to become readable/writable
+// ==============================================================================
+// Used by the epoll backend. Owned by the socket on the heap, so its address
+// (which epoll hands back in epoll_event::data) survives moving the socket.
+struct FdWaiters {
+  int fd{-1};
+  bool registered{false};
+  std::coroutine_handle<> reader{nullptr};
+  std::coroutine_handle<> writer{nullptr};
+};
+
+// ==============================================================================
+// Loop: Ready queue plus the I/O backend
+// ==============================================================================
+// run() resumes ready coroutines; when none are left it waits for I/O and
+// returns once no coroutine and no I/O is outstanding.
+// - io_uring: submits the pending SQEs and waits for CQEs in one call; an
+//   armed multishot request only counts while a coroutine is parked on it
+// - Epoll: waits in epoll_wait() for socket readiness and for posts from the
+//   file thread pool, which arrive through an eventfd
+// force_fallback switches new I/O to the epoll backend, e.g. to compare the
+// two; only change it while no I/O is in flight.
+enum class IoBackend { IoUring, Epoll };
+
+struct Loop {
+  Loop()
+      : ring(IoUring::create(256)), epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+        post_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (epoll_fd < 0 || post_fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "epoll/eventfd");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;  // nullptr: the post eventfd
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, post_fd, &event);
+  }
+
+  Loop(const Loop &) = delete;
+  Loop &operator=(const Loop &) = delete;
+
+  ~Loop() {
+    close(post_fd);
+    close(epoll_fd);
+  }
+
+  IoBackend backend() const {
+    return ring && !force_fallback ? IoBackend::IoUring : IoBackend::Epoll;
+  }
+
+  void add_task(std::coroutine_handle<> handle) { ready_tasks.push(handle); }
+
+  // expect_post() / post(): As in generator-pipeline.cc; post() is the only
+  // member other threads may call
+  void expect_post() {
+    std::lock_guard lock(post_mutex);
+    ++expected_posts;
+  }
+
+  void post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard lock(post_mutex);
+      posted_tasks.push_back(handle);
+      --expected_posts;
+    }
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(post_fd, &one, sizeof(one));
+  }
+
+  // prepare_sqe(): An SQE for 'request', submitted the next time run() is
+  // idle
+  // - SQ ring full: submit what is there; waiting for a CQE instead could
+  //   block forever when every request in flight is an idle recv
+  // - One-shot cap reached (kernels without NODROP): collect completions
+  io_uring_sqe &prepare_sqe(IoRequest &request) {
+    while (!ring->has_room()) {
+      ring->submit_and_wait(ring->sq_full() ? 0 : 1);
+      reap();
+    }
+    return ring->next_sqe(request);
+  }
+
+  // wait_fd(): Park 'coroutine' until waiters.fd is readable or writable
+  // - The fd is registered edge-triggered for both directions on first use;
+  //   closing it removes it from the epoll set
+  void wait_fd(FdWaiters &waiters, bool write, std::coroutine_handle<> coroutine) {
+    if (!waiters.registered) {
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      event.data.ptr = &waiters;
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, waiters.fd, &event) < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+      }
+      waiters.registered = true;
+    }
+    (write ? waiters.writer : waiters.reader) = coroutine;
+    ++fd_waiting;
+  }
+
+  // register_buffer_ring() / unregister_buffer_ring(): For BufferPool; false
+  // without io_uring or on kernels before 5.19
+  bool register_buffer_ring(io_uring_buf_ring *buffers, unsigned entries,
+                            std::uint16_t group) {
+    return ring && ring->register_buffer_ring(buffers, entries, group);
+  }
+
+  void unregister_buffer_ring(std::uint16_t group) {
+    ring->unregister_buffer_ring(group);
+  }
+
+  void run() {
+    while (true) {
+      {
+        std::lock_guard lock(post_mutex);
+        for (std::coroutine_handle<> handle : posted_tasks) {
+          ready_tasks.push(handle);
+        }
+        posted_tasks.clear();
+      }
+
+      if (!ready_tasks.empty()) {
+        std::coroutine_handle<> handle = ready_tasks.front();
+        ready_tasks.pop();
+        handle.resume();
+        continue;
+      }
+
+      if (ring && (ring->pending() != 0 || multishot_waiters != 0 || orphans != 0)) {
+        ring->submit_and_wait(1);
+        reap();
+        continue;
+      }
+
+      {
+        std::lock_guard lock(post_mutex);
+        if (expected_posts == 0 && posted_tasks.empty() && fd_waiting == 0) {
+          return;
+        }
+      }
+      wait_events();
+    }
+  }
+
+  bool force_fallback{false};
+
+  // Multishot bookkeeping (see Multishot): coroutines parked on an armed
+  // multishot request, and released requests still waiting for their last
+  // CQE. An armed request nobody waits on does not keep run() going.
+  std::size_t multishot_waiters{0};
+  std::size_t orphans{0};
+
+  // Multishot support, per operation: accept needs Linux 5.19, recv 6.0.
+  // Older kernels reject the flag with EINVAL; the first such CQE clears
+  // the flag for good and the caller goes back to one-shot requests.
+  bool multishot_accept{true};
+  bool multishot_recv{true};
+
+private:
+  void reap() {
+    ring->reap([this](IoRequest &request, int result, std::uint32_t flags) {
+      if (request.on_cqe) {
+        request.on_cqe(request, result, flags);
+        return;
+      }
+      request.result = result;
+      add_task(request.handle);
+    });
+  }
+
+  // wait_events(): One epoll_wait(); wakes the fds' waiters
+  void wait_events() {
+    epoll_event events[64];
+    int count = epoll_wait(epoll_fd, events, 64, -1);
+    if (count < 0 && errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+    for (int i = 0; i < count; ++i) {
+      auto *waiters = static_cast<FdWaiters *>(events[i].data.ptr);
+      if (!waiters) {
+        std::uint64_t posts;
+        [[maybe_unused]] ssize_t got = read(post_fd, &posts, sizeof(posts));
+        continue;
+      }
+      std::uint32_t flags = events[i].events;
+      std::uint32_t failed = EPOLLERR | EPOLLHUP;
+      if (waiters->reader && (flags & (EPOLLIN | EPOLLRDHUP | failed))) {
+        add_task(std::exchange(waiters->reader, nullptr));
+        --fd_waiting;
+      }
+      if (waiters->writer && (flags & (EPOLLOUT | failed))) {
+        add_task(std::exchange(waiters->writer, nullptr));
+        --fd_waiting;
+      }
+    }
+  }
+
+  std::unique_ptr<IoUring> ring;
+  std::queue<std::coroutine_handle<>> ready_tasks;
+
+  int epoll_fd;
+  int post_fd;
+  std::size_t fd_waiting{0};
+
+  std::mutex post_mutex;
+  std::vector<std::coroutine_handle<>> posted_tasks;
+  std::size_t expected_posts{0};
+};
+
+Loop &get_global_loop() {
+  static Loop global_loop;
+  return global_loop;
+}
+
+// ==============================================================================
+// TransferAwaiter / Task: Lazy coroutine returning T (as in
+// generator-pipeline.cc)
+// ==============================================================================
+struct TransferAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> /*from*/) noexcept {
+    return next;
+  }
+
+  void await_resume() noexcept {}
+
+  std::coroutine_handle<> next;
+};
+
+template <typename T> struct TaskResult {
+  void return_value(T val) { value = std::move(val); }
+
+  T result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+
+  std::optional<T> value{std::nullopt};
+  std::exception_ptr exception{nullptr};
+};
+
+template <> struct TaskResult<void> {
+  void return_void() {}
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  std::exception_ptr exception{nullptr};
+};
+
+template <typename T> struct TaskPromise : TaskResult<T> {
+  auto initial_suspend() noexcept { return std::suspend_always{}; }
+
+  auto final_suspend() noexcept { return TransferAwaiter{continuation}; }
+
+  void unhandled_exception() { this->exception = std::current_exception(); }
+
+  std::coroutine_handle<TaskPromise> get_return_object() {
+    return std::coroutine_handle<TaskPromise>::from_promise(*this);
+  }
+
+  // continuation: The coroutine awaiting this one (noop for a root task)
+  std::coroutine_handle<> continuation{std::noop_coroutine()};
+};
+
+template <typename T = void> struct Task {
+  using promise_type = TaskPromise<T>;
+
+  Task(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  Task(Task &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~Task() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+      coroutine.promise().continuation = caller;
+      return coroutine;
+    }
+
+    T await_resume() { return coroutine.promise().result(); }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  Awaiter operator co_await() { return Awaiter{coroutine}; }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// run_on_loop(): Start a root task on the global Loop and run until idle
+template <typename T> T run_on_loop(Task<T> task) {
+  get_global_loop().add_task(task.coroutine);
+  get_global_loop().run();
+  return task.coroutine.promise().result();
+}
+
+// run_all(): Start several root tasks at once; rethrows the first failure
+void run_all(std::vector<Task<>> &tasks) {
+  for (Task<> &task : tasks) {
+    get_global_loop().add_task(task.coroutine);
+  }
+  get_global_loop().run();
+  for (Task<> &task : tasks) {
+    task.coroutine.promise().result();
+  }
+}
+
+// ==============================================================================
+// File: An owned file descriptor
+// ==============================================================================
+struct File {
+  static File open(const std::string &path, int flags, mode_t mode = 0644) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    return File(fd);
+  }
+
+  explicit File(int fd) : fd(fd) {}
+
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  File(File &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+
+  File &operator=(File &&other) noexcept {
+    if (this != &other) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      fd = std::exchange(other.fd, -1);
+    }
+    return *this;
+  }
+
+  ~File() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  std::uint64_t size() const {
+    struct stat status {};
+    if (fstat(fd, &status) < 0) {
+      throw std::system_error(errno, std::generic_category(), "fstat");
+    }
+    return std::uint64_t(status.st_size);
+  }
+
+  int fd;
+};
+
+// ==============================================================================
+// async_read / async_write
+// ==============================================================================
+// co_await returns the number of bytes transferred, which like pread() /
+// pwrite() may be less than requested (end of file, or more than 2 GiB
+// asked for at once). Errors are thrown as std::system_error.
+//
+// The buffer must stay valid until the co_await returns; it is only safe to
+// drop the awaiting coroutine after that.
+struct FileAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    request.handle = coroutine;
+    Loop &loop = get_global_loop();
+    if (loop.backend() == IoBackend::IoUring) {
+      io_uring_sqe &sqe = loop.prepare_sqe(request);
+      sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+      sqe.fd = fd;
+      sqe.off = offset;
+      sqe.addr = reinterpret_cast<std::uint64_t>(data);
+      sqe.len = unsigned(size);
+      return;
+    }
+    loop.expect_post();
+    get_io_pool().submit([this] {
+      ssize_t done = write ? pwrite(fd, data, size, off_t(offset))
+                           : pread(fd, data, size, off_t(offset));
+      request.result = done < 0 ? -errno : int(done);
+      get_global_loop().post(request.handle);  // 'this' may be gone after
+    });
+  }
+
+  std::size_t await_resume() {
+    if (request.result < 0) {
+      throw std::system_error(-request.result, std::generic_category(),
+                              write ? "async_write" : "async_read");
+    }
+    return std::size_t(request.result);
+  }
+
+  int fd;
+  std::uint64_t offset;
+  void *data;
+  std::size_t size;
+  bool write;
+  IoRequest request{};
+};
+
+// max_transfer: Bigger requests are cut to this and return a short count
+constexpr std::size_t max_transfer = std::size_t(1) << 30;
+
+FileAwaiter async_read(const File &file, std::uint64_t offset,
+                       std::span<std::byte> buffer) {
+  return FileAwaiter{file.fd, offset, buffer.data(),
+                     std::min(buffer.size(), max_transfer), false};
+}
+
+FileAwaiter async_write(const File &file, std::uint64_t offset,
+                        std::span<const std::byte> data) {
+  return FileAwaiter{file.fd, offset, const_cast<std::byte *>(data.data()),
+                     std::min(data.size(), max_transfer), true};
+}
+
+// ==============================================================================
+// Detached: A coroutine nobody awaits; its frame is freed when it finishes
+// ==============================================================================
+// spawn() runs a Task<> this way, e.g. one connection handler per client.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// spawn(): The task's exception, if any, ends the program
+Detached spawn(Task<> task) { co_await task; }
+
+// ==============================================================================
+// Sockets: TCP over IPv4, non-blocking fds
+// ==============================================================================
+// Listener::bind() / connect() / Listener::accept() / Socket::read_some() /
+// Socket::write_all() are coroutines that use whichever backend the Loop
+// has:
+// - io_uring: one IORING_OP_CONNECT / RECV / SEND per call; the kernel
+//   waits for readiness itself. accept() and receive() use multishot
+//   requests instead (see Multishot) where the kernel supports them.
+// - Epoll: try the syscall; on EAGAIN park on the fd and retry when epoll
+//   reports it ready
+// Errors are thrown as std::system_error; read_some() returns 0 and
+// receive() an empty buffer at end of stream. A socket must outlive any
+// operation in progress on it, only one coroutine at a time may read (or
+// write) a given socket, and a socket is read either with read_some() or
+// with receive(), not both.
+
+// UringAwaiter: One SQE, filled in by 'prepare'; resumes with the CQE result
+template <typename Prepare> struct UringAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    request.handle = coroutine;
+    prepare(get_global_loop().prepare_sqe(request));
+  }
+
+  int await_resume() noexcept { return request.result; }
+
+  Prepare prepare;
+  IoRequest request{};
+};
+
+template <typename Prepare> UringAwaiter<Prepare> uring_op(Prepare prepare) {
+  return UringAwaiter<Prepare>{std::move(prepare)};
+}
+
+// ReadyAwaiter: Park on the epoll backend until the fd is ready
+struct ReadyAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    get_global_loop().wait_fd(*waiters, write, coroutine);
+  }
+
+  void await_resume() noexcept {}
+
+  FdWaiters *waiters;
+  bool write;
+};
+
+// check(): -errno results become exceptions
+int check(int result, const char *what) {
+  if (result < 0) {
+    throw std::system_error(-result, std::generic_category(), what);
+  }
+  return result;
+}
+
+bool would_block(int error) { return error == EAGAIN || error == EWOULDBLOCK; }
+
+// ignored_request: The user_data of SQEs whose CQE needs no handling
+// (cancelling a multishot request)
+IoRequest ignored_request{nullptr, 0, [](IoRequest &, int, std::uint32_t) {}};
+
+// ==============================================================================
+// Multishot: One armed SQE that keeps producing results
+// ==============================================================================
+// Multishot accept (Linux 5.19+) and multishot recv (6.0+) post a CQE per
+// accepted connection / received chunk until they end: on an error, at end
+// of stream, or when the buffer pool runs dry. The results queue up in
+// 'items' until a coroutine takes them; a coroutine that finds the queue
+// empty parks in 'waiter' until the next CQE.
+//
+// The kernel holds the request's address until its last CQE, so the owner
+// does not delete an armed request: release() cancels it instead, and the
+// CQE handler frees it once the last CQE is in (the Loop's 'orphans').
+template <typename Item> struct Multishot : IoRequest {
+  // Awaiter: Park until the next CQE; only while armed
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> coroutine) noexcept {
+      state->waiter = coroutine;
+      ++get_global_loop().multishot_waiters;
+    }
+
+    void await_resume() noexcept {}
+
+    Multishot *state;
+  };
+
+  Awaiter next_cqe() { return Awaiter{this}; }
+
+  bool empty() const { return taken == items.size(); }
+
+  // take(): The oldest queued item
+  Item take() {
+    Item item = items[taken++];
+    if (taken == items.size()) {
+      items.clear();
+      taken = 0;
+    }
+    return item;
+  }
+
+  // arm(): Queue the SQE; 'prepare' fills in the operation
+  template <typename Prepare> void arm(Prepare prepare) {
+    prepare(get_global_loop().prepare_sqe(*this));
+    armed = true;
+    cqes = 0;
+  }
+
+  // settle(): The end of every CQE handler; true when the request is an
+  // orphan that just got its last CQE, and the handler must free it
+  bool settle(std::uint32_t flags) {
+    Loop &loop = get_global_loop();
+    ++cqes;
+    if (!(flags & IORING_CQE_F_MORE)) {
+      armed = false;
+    }
+    if (waiter) {
+      loop.add_task(std::exchange(waiter, nullptr));
+      --loop.multishot_waiters;
+    }
+    if (orphaned && !armed) {
+      --loop.orphans;
+      return true;
+    }
+    return false;
+  }
+
+  // release(): For the owner; true if the request can be freed right away,
+  // otherwise it is cancelled and freed after its last CQE
+  bool release() {
+    if (!armed) {
+      return true;
+    }
+    Loop &loop = get_global_loop();
+    orphaned = true;
+    ++loop.orphans;
+    io_uring_sqe &sqe = loop.prepare_sqe(ignored_request);
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.addr = reinterpret_cast<std::uint64_t>(static_cast<IoRequest *>(this));
+    return false;
+  }
+
+  // rejected(): The kernel refused the multishot flag itself (see
+  // Loop::multishot_accept): EINVAL as the only CQE since arm(). Nothing
+  // was produced, and a one-shot request can take over.
+  bool rejected() const {
+    return error == EINVAL && cqes == 1 && empty() && !armed;
+  }
+
+  // items: A vector rather than a deque, since an empty one allocates
+  // nothing, and most sockets have nothing queued most of the time
+  std::vector<Item> items;
+  std::size_t taken{0};
+  std::coroutine_handle<> waiter{nullptr};
+  int error{0};  // errno that ended the request
+  std::size_t cqes{0};  // CQEs since the last arm()
+  bool armed{false};
+  bool finished{false};  // end of stream: nothing more will come
+  bool orphaned{false};
+};
+
+// ReleaseMultishot: unique_ptr deleter for the owner of a Multishot
+template <typename Queue> struct ReleaseMultishot {
+  void operator()(Queue *queue) const {
+    if (queue->release()) {
+      queue->drop();
+      delete queue;
+    }
+  }
+};
+
+// ==============================================================================
+// BufferPool: Receive buffers shared by all connections
+// ==============================================================================
+// read_some() needs its buffer for as long as the read is pending, so a
+// server with a read posted on each of 1M idle connections pins 1M buffers.
+// receive() leases a buffer from this pool only once data has arrived:
+// - io_uring: the buffers are lent to the kernel as a provided-buffer ring
+//   (IORING_REGISTER_PBUF_RING, Linux 5.19+). A multishot recv names the
+//   buffer group instead of a buffer; the kernel picks one when data
+//   arrives, and the CQE says which. Giving a buffer back is a store to the
+//   ring and a release store of its tail, no syscall.
+// - Some kernels accept the ring but then never select from it (ENOBUFS);
+//   probe() checks with a one-byte read, and if so the buffers are lent
+//   with IORING_OP_PROVIDE_BUFFERS instead, one SQE per batch returned.
+//   A failed batch (its CQE) goes back to 'returning' for the next flush().
+// - The ring path (register_ring(), provide()) is unverified: on the kernel
+//   this was developed on (6.18) the ring registers, PBUF_STATUS reports it
+//   with the entry published, and selection still fails with ENOBUFS, also
+//   for a kernel-allocated ring; so probe() always picked ProvideBuffers.
+// - Epoll, or no ring support: receive() takes a buffer from a free list
+//   for the recv() call itself, and gives it back if there was no data.
+// A receiver that finds the pool empty waits for a buffer to come back.
+enum class Provision { FreeList, Ring, ProvideBuffers };
+
+struct BufferPool {
+  // BufferPool(): 'count' buffers of 'buffer_size' bytes, lent to 'loop's
+  // io_uring if it is given and supports it
+  BufferPool(unsigned count, std::size_t buffer_size, Loop *loop)
+      : count(count), buffer_size(buffer_size),
+        memory(std::make_unique_for_overwrite<std::byte[]>(count * buffer_size)) {
+    if (count == 0 || count > 32768 || (count & (count - 1)) != 0) {
+      throw std::invalid_argument("BufferPool: count must be a power of 2 <= 32768");
+    }
+    if (loop) {
+      provision = probe();
+    }
+    if (provision == Provision::Ring) {
+      if (register_ring(*loop)) {
+        return;
+      }
+      provision = Provision::FreeList;
+    }
+    std::vector<std::uint16_t> &ids =
+        provision == Provision::ProvideBuffers ? returning : free_ids;
+    for (unsigned id = count; id-- > 0;) {
+      ids.push_back(std::uint16_t(id));
+    }
+    if (provision == Provision::ProvideBuffers) {
+      this->loop = loop;
+      provide_requests = std::make_unique<ProvideRequest[]>(count);
+      for (unsigned id = 0; id < count; ++id) {
+        provide_requests[id].pool = this;
+        provide_requests[id].on_cqe = &BufferPool::provide_failed;
+      }
+      flush();
+    }
+  }
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  ~BufferPool() {
+    if (ring) {
+      loop->unregister_buffer_ring(group);
+      munmap(ring, ring_bytes());
+    }
+  }
+
+  // provided(): The kernel picks the buffers (multishot recv can be used)
+  bool provided() const { return provision != Provision::FreeList; }
+
+  std::span<std::byte> buffer(std::uint16_t id) {
+    return {memory.get() + std::size_t(id) * buffer_size, buffer_size};
+  }
+
+  // handed_out(): Called when a buffer leaves the pool (CQE or take())
+  void handed_out() {
+    ++in_use;
+    peak_in_use = std::max(peak_in_use, in_use);
+  }
+
+  // recycle(): Give a buffer back and wake one coroutine waiting for one
+  // - Safe in a CQE handler: with ProvideBuffers the buffer only waits in
+  //   'returning' until the next flush()
+  void recycle(std::uint16_t id) {
+    --in_use;
+    if (provision == Provision::Ring) {
+      provide(id);
+    } else if (provision == Provision::ProvideBuffers) {
+      returning.push_back(id);
+    } else {
+      free_ids.push_back(id);
+    }
+    if (!waiting.empty()) {
+      get_global_loop().add_task(waiting.front());
+      waiting.pop_front();
+    }
+  }
+
+  // flush(): ProvideBuffers only: lend the returned buffers to the kernel,
+  // one SQE per run of consecutive ids; not from a CQE handler
+  // - Buffers whose last PROVIDE_BUFFERS failed are retried with the rest
+  void flush() {
+    if (returning.empty()) {
+      return;
+    }
+    unlent = 0;
+    std::vector<std::uint16_t> batch = std::exchange(returning, {});
+    std::sort(batch.begin(), batch.end());
+    for (std::size_t first = 0, last; first < batch.size(); first = last) {
+      for (last = first + 1; last < batch.size() && batch[last] == batch[last - 1] + 1;
+           ++last) {
+      }
+      ProvideRequest &request = provide_requests[batch[first]];
+      request.first = batch[first];
+      request.count = std::uint16_t(last - first);
+      io_uring_sqe &sqe = loop->prepare_sqe(request);
+      sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+      sqe.fd = int(last - first);
+      sqe.addr = reinterpret_cast<std::uint64_t>(buffer(batch[first]).data());
+      sqe.len = unsigned(buffer_size);
+      sqe.off = batch[first];
+      sqe.buf_group = group;
+    }
+  }
+
+  // exhausted(): No buffer is left for the kernel to pick
+  bool exhausted() const { return in_use + unlent == count; }
+
+  // returned(): Park until a buffer comes back to the pool
+  struct ReturnAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> coroutine) {
+      pool->waiting.push_back(coroutine);
+    }
+
+    void await_resume() noexcept {}
+
+    BufferPool *pool;
+  };
+
+  ReturnAwaiter returned() { return ReturnAwaiter{this}; }
+
+  // take(): A buffer from the free list (FreeList pools only)
+  Task<std::uint16_t> take() {
+    while (free_ids.empty()) {
+      co_await returned();
+    }
+    std::uint16_t id = free_ids.back();
+    free_ids.pop_back();
+    handed_out();
+    co_return id;
+  }
+
+  const unsigned count;
+  const std::size_t buffer_size;
+  static constexpr std::uint16_t group = 0;  // io_uring buffer group id
+
+  std::size_t in_use{0};  // leased, queued, or being received into
+  std::size_t peak_in_use{0};
+  Provision provision{Provision::FreeList};
+  std::size_t unlent{0};   // ProvideBuffers: in 'returning' after a failure
+  int provide_error{0};    // errno of the last failed PROVIDE_BUFFERS
+
+private:
+  // ProvideRequest: The user_data of a PROVIDE_BUFFERS SQE, so that its CQE
+  // knows which buffers it covered. There is one per buffer id, used by the
+  // batch starting at that id: a buffer cannot start a second batch before
+  // the kernel has taken it, which is after the first batch's CQE.
+  struct ProvideRequest : IoRequest {
+    BufferPool *pool{nullptr};
+    std::uint16_t first{0};
+    std::uint16_t count{0};
+  };
+
+  // provide_failed(): The CQE of a PROVIDE_BUFFERS SQE; on failure (e.g.
+  // ENOMEM) the buffers never reached the kernel, so they wait in
+  // 'returning' for the next flush() and count as unavailable until then
+  static void provide_failed(IoRequest &request, int result, std::uint32_t) {
+    if (result >= 0) {
+      return;
+    }
+    auto &batch = static_cast<ProvideRequest &>(request);
+    BufferPool &pool = *batch.pool;
+    for (unsigned i = 0; i < batch.count; ++i) {
+      pool.returning.push_back(std::uint16_t(batch.first + i));
+    }
+    pool.unlent += batch.count;
+    pool.provide_error = -result;
+  }
+
+  std::size_t ring_bytes() const { return count * sizeof(io_uring_buf); }
+
+  // probe(): Which way of lending buffers this kernel supports, tried on a
+  // scratch io_uring so the Loop's own ring is not involved
+  static Provision probe() {
+    std::unique_ptr<IoUring> scratch = IoUring::create(2);
+    void *page = mmap(nullptr, 4096, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!scratch || page == MAP_FAILED) {
+      return Provision::FreeList;
+    }
+    auto *probe_ring = static_cast<io_uring_buf_ring *>(page);
+    char byte = 0;
+    probe_ring->bufs[0].addr = reinterpret_cast<std::uint64_t>(&byte);
+    probe_ring->bufs[0].len = 1;
+    probe_ring->bufs[0].bid = 0;
+    std::atomic_ref(probe_ring->tail).store(1, std::memory_order_release);
+
+    Provision provision = Provision::FreeList;
+    int fds[2];
+    if (scratch->register_buffer_ring(probe_ring, 1, group) &&
+        pipe2(fds, O_CLOEXEC) == 0) {
+      provision = Provision::ProvideBuffers;
+      if (write(fds[1], "x", 1) == 1) {
+        IoRequest request{};
+        io_uring_sqe &sqe = scratch->next_sqe(request);
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fds[0];
+        sqe.flags = IOSQE_BUFFER_SELECT;
+        sqe.buf_group = group;
+        scratch->submit_and_wait(1);
+        scratch->reap([&](IoRequest &, int result, std::uint32_t) {
+          if (result == 1) {
+            provision = Provision::Ring;
+          }
+        });
+      }
+      close(fds[0]);
+      close(fds[1]);
+    }
+    scratch.reset();  // unregisters the ring before its memory goes
+    munmap(page, 4096);
+    return provision;
+  }
+
+  bool register_ring(Loop &target) {
+    void *ring_memory = mmap(nullptr, ring_bytes(), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_memory == MAP_FAILED) {
+      return false;
+    }
+    ring = static_cast<io_uring_buf_ring *>(ring_memory);
+    for (unsigned id = 0; id < count; ++id) {
+      provide(std::uint16_t(id));
+    }
+    if (!target.register_buffer_ring(ring, count, group)) {
+      munmap(ring, ring_bytes());
+      ring = nullptr;
+      return false;
+    }
+    loop = &target;
+    return true;
+  }
+
+  // provide(): Append buffer 'id' to the ring and publish the new tail
+  // - Only addr/len/bid are written: the 'resv' of entry 0 is the tail
+  void provide(std::uint16_t id) {
+    io_uring_buf &entry = ring->bufs[ring_tail & (count - 1)];
+    entry.addr = reinterpret_cast<std::uint64_t>(buffer(id).data());
+    entry.len = unsigned(buffer_size);
+    entry.bid = id;
+    ++ring_tail;
+    std::atomic_ref(ring->tail).store(ring_tail, std::memory_order_release);
+  }
+
+  std::unique_ptr<std::byte[]> memory;
+  Loop *loop{nullptr};
+  io_uring_buf_ring *ring{nullptr};
+  std::uint16_t ring_tail{0};
+  std::vector<std::uint16_t> free_ids;
+  std::vector<std::uint16_t> returning;  // ProvideBuffers: not lent back yet
+  std::unique_ptr<ProvideRequest[]> provide_requests;  // ProvideBuffers
+  std::deque<std::coroutine_handle<>> waiting;
+};
+
+// get_buffer_pool(): The pool for the Loop's current backend
+// - Sized for the data being handled at once, not for the number of
+//   connections: 1024 x 4 KiB
+BufferPool &get_buffer_pool() {
+  constexpr unsigned buffers = 1024;
+  constexpr std::size_t buffer_size = 4096;
+  Loop &loop = get_global_loop();
+  if (loop.backend() == IoBackend::IoUring) {
+    static BufferPool provided(buffers, buffer_size, &loop);
+    return provided;
+  }
+  static BufferPool plain(buffers, buffer_size, nullptr);
+  return plain;
+}
+
+// ReceivedBuffer: One received chunk in a pool buffer; the buffer goes back
+// to the pool when this is destroyed. Empty at end of stream.
+struct ReceivedBuffer {
+  ReceivedBuffer() = default;
+
+  ReceivedBuffer(BufferPool &pool, std::uint16_t id, std::size_t size)
+      : pool(&pool), id(id), length(size) {}
+
+  ReceivedBuffer(const ReceivedBuffer &) = delete;
+  ReceivedBuffer &operator=(const ReceivedBuffer &) = delete;
+
+  ReceivedBuffer(ReceivedBuffer &&other) noexcept
+      : pool(std::exchange(other.pool, nullptr)), id(other.id),
+        length(std::exchange(other.length, 0)) {}
+
+  ReceivedBuffer &operator=(ReceivedBuffer &&other) noexcept {
+    if (this != &other) {
+      reset();
+      pool = std::exchange(other.pool, nullptr);
+      id = other.id;
+      length = std::exchange(other.length, 0);
+    }
+    return *this;
+  }
+
+  ~ReceivedBuffer() { reset(); }
+
+  std::span<const std::byte> data() const {
+    return pool ? pool->buffer(id).first(length) : std::span<const std::byte>();
+  }
+
+  std::size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+
+private:
+  void reset() {
+    if (pool) {
+      BufferPool *owner = std::exchange(pool, nullptr);
+      owner->recycle(id);
+      owner->flush();
+    }
+    length = 0;
+  }
+
+  BufferPool *pool{nullptr};
+  std::uint16_t id{0};
+  std::size_t length{0};
+};
+
+// RecvQueue: A socket's multishot recv; each item is a pool buffer id and
+// the number of bytes received into it
+struct ReceivedChunk {
+  std::uint16_t id;
+  std::uint32_t size;
+};
+
+struct RecvQueue : Multishot<ReceivedChunk> {
+  explicit RecvQueue(BufferPool &pool) : pool(pool) { on_cqe = &RecvQueue::complete; }
+
+  static void complete(IoRequest &request, int result, std::uint32_t flags) {
+    auto &self = static_cast<RecvQueue &>(request);
+    if (flags & IORING_CQE_F_BUFFER) {
+      auto id = std::uint16_t(flags >> IORING_CQE_BUFFER_SHIFT);
+      self.pool.handed_out();
+      if (result > 0 && !self.orphaned) {
+        self.items.push_back({id, std::uint32_t(result)});
+      } else {
+        self.pool.recycle(id);
+      }
+    } else if (result == 0) {
+      self.finished = true;
+    } else if (result == -ENOBUFS) {
+      self.starved = true;  // receive() waits for a buffer and re-arms
+    } else if (result != -ECANCELED) {
+      self.error = -result;
+    }
+    if (self.settle(flags)) {
+      self.drop();
+      delete &self;
+    }
+  }
+
+  // drop(): Give the queued chunks' buffers back
+  void drop() {
+    while (!empty()) {
+      pool.recycle(take().id);
+    }
+  }
+
+  BufferPool &pool;
+  bool starved{false};
+  bool multishot{false};  // armed with IORING_RECV_MULTISHOT
+};
+
+// AcceptQueue: A listener's multishot accept; each item is a new socket fd
+struct AcceptQueue : Multishot<int> {
+  AcceptQueue() { on_cqe = &AcceptQueue::complete; }
+
+  static void complete(IoRequest &request, int result, std::uint32_t flags) {
+    auto &self = static_cast<AcceptQueue &>(request);
+    if (result >= 0) {
+      self.items.push_back(result);
+    } else if (result != -ECANCELED) {
+      self.error = -result;
+    }
+    if (self.settle(flags)) {
+      self.drop();
+      delete &self;
+    }
+  }
+
+  void drop() {
+    while (!empty()) {
+      close(take());
+    }
+  }
+};
+
+struct Socket {
+  explicit Socket(int fd) : waiters(std::make_unique<FdWaiters>()) {
+    waiters->fd = fd;
+  }
+
+  Socket(Socket &&) noexcept = default;
+
+  Socket &operator=(Socket &&other) noexcept {
+    if (this != &other) {
+      close_fd();
+      waiters = std::move(other.waiters);
+      received = std::move(other.received);
+    }
+    return *this;
+  }
+
+  ~Socket() { close_fd(); }
+
+  int fd() const { return waiters->fd; }
+
+  Task<std::size_t> read_some(std::span<std::byte> buffer) {
+    if (get_global_loop().backend() == IoBackend::IoUring) {
+      co_return std::size_t(check(co_await uring_op([&](io_uring_sqe &sqe) {
+        sqe.opcode = IORING_OP_RECV;
+        sqe.fd = fd();
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer.data());
+        sqe.len = unsigned(std::min(buffer.size(), max_chunk));
+      }), "recv"));
+    }
+    while (true) {
+      ssize_t got = recv(fd(), buffer.data(), buffer.size(), 0);
+      if (got >= 0) {
+        co_return std::size_t(got);
+      }
+      if (!would_block(errno)) {
+        check(-errno, "recv");
+      }
+      co_await ReadyAwaiter{waiters.get(), false};
+    }
+  }
+
+  // receive(): The next chunk of the stream, in a buffer from
+  // get_buffer_pool(); see BufferPool
+  // - io_uring: one multishot recv stays armed between calls; chunks that
+  //   arrive meanwhile queue up, each holding its buffer until taken
+  // - Kernels with provided buffers but no multishot recv (5.19): the same
+  //   queue, re-armed with a one-shot recv that selects a pool buffer
+  Task<ReceivedBuffer> receive() {
+    BufferPool &pool = get_buffer_pool();
+    Loop &loop = get_global_loop();
+    if (pool.provided()) {
+      if (!received) {
+        received.reset(new RecvQueue(pool));
+      }
+      RecvQueue &queue = *received;
+      while (queue.empty()) {
+        if (queue.multishot && queue.rejected()) {
+          loop.multishot_recv = false;
+          queue.error = 0;
+        }
+        if (queue.error) {
+          check(-queue.error, "recv");
+        }
+        if (queue.finished) {
+          co_return ReceivedBuffer();
+        }
+        if (!queue.armed) {
+          if (std::exchange(queue.starved, false)) {
+            while (pool.exhausted()) {
+              if (pool.in_use == 0) {
+                // No buffer reached the kernel, and none is out to return
+                check(-pool.provide_error, "provide buffers");
+              }
+              co_await pool.returned();
+            }
+          }
+          pool.flush();
+          queue.multishot = loop.multishot_recv;
+          queue.arm([&](io_uring_sqe &sqe) {
+            sqe.opcode = IORING_OP_RECV;
+            sqe.fd = fd();
+            sqe.ioprio = queue.multishot ? IORING_RECV_MULTISHOT : 0;
+            sqe.flags = IOSQE_BUFFER_SELECT;
+            sqe.buf_group = BufferPool::group;
+          });
+        }
+        co_await queue.next_cqe();
+      }
+      ReceivedChunk chunk = queue.take();
+      co_return ReceivedBuffer(pool, chunk.id, chunk.size);
+    }
+    while (true) {
+      std::uint16_t id = co_await pool.take();
+      std::span<std::byte> buffer = pool.buffer(id);
+      int got;
+      if (loop.backend() == IoBackend::IoUring) {
+        // No provided-buffer rings: the buffer stays taken while we wait
+        got = co_await uring_op([&](io_uring_sqe &sqe) {
+          sqe.opcode = IORING_OP_RECV;
+          sqe.fd = fd();
+          sqe.addr = reinterpret_cast<std::uint64_t>(buffer.data());
+          sqe.len = unsigned(buffer.size());
+        });
+      } else {
+        ssize_t done = recv(fd(), buffer.data(), buffer.size(), 0);
+        got = done >= 0 ? int(done) : -errno;
+      }
+      if (got > 0) {
+        co_return ReceivedBuffer(pool, id, std::size_t(got));
+      }
+      pool.recycle(id);
+      if (got == 0) {
+        co_return ReceivedBuffer();
+      }
+      if (!would_block(-got)) {
+        check(got, "recv");
+      }
+      co_await ReadyAwaiter{waiters.get(), false};
+    }
+  }
+
+  // write_all(): Sends the whole buffer, over as many sends as it takes
+  Task<> write_all(std::span<const std::byte> data) {
+    const bool uring = get_global_loop().backend() == IoBackend::IoUring;
+    while (!data.empty()) {
+      int sent;
+      if (uring) {
+        sent = co_await uring_op([&](io_uring_sqe &sqe) {
+          sqe.opcode = IORING_OP_SEND;
+          sqe.fd = fd();
+          sqe.addr = reinterpret_cast<std::uint64_t>(data.data());
+          sqe.len = unsigned(std::min(data.size(), max_chunk));
+          sqe.msg_flags = MSG_NOSIGNAL;
+        });
+      } else {
+        ssize_t done = send(fd(), data.data(), data.size(), MSG_NOSIGNAL);
+        sent = done >= 0 ? int(done) : -errno;
+        if (done < 0 && would_block(errno)) {
+          co_await ReadyAwaiter{waiters.get(), true};
+          continue;
+        }
+      }
+      data = data.subspan(std::size_t(check(sent, "send")));
+    }
+  }
+
+  static constexpr std::size_t max_chunk = std::size_t(1) << 30;
+
+  std::unique_ptr<FdWaiters> waiters;
+  std::unique_ptr<RecvQueue, ReleaseMultishot<RecvQueue>> received;
+
+private:
+  void close_fd() {
+    if (waiters && waiters->fd >= 0) {
+      close(std::exchange(waiters->fd, -1));
+    }
+  }
+};
+
+// tcp_socket(): A non-blocking TCP socket with Nagle off (ping-pong
+// traffic would otherwise wait for delayed ACKs)
+int tcp_socket() {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+sockaddr_in ipv4_address(const std::string &host, std::uint16_t port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    throw std::invalid_argument("not an IPv4 address: " + host);
+  }
+  return address;
+}
+
+Task<Socket> connect(std::string host, std::uint16_t port) {
+  Socket socket(tcp_socket());
+  sockaddr_in address = ipv4_address(host, port);
+  auto *raw = reinterpret_cast<sockaddr *>(&address);
+  if (get_global_loop().backend() == IoBackend::IoUring) {
+    check(co_await uring_op([&](io_uring_sqe &sqe) {
+      sqe.opcode = IORING_OP_CONNECT;
+      sqe.fd = socket.fd();
+      sqe.addr = reinterpret_cast<std::uint64_t>(raw);
+      sqe.off = sizeof(address);
+    }), "connect");
+    co_return socket;
+  }
+  if (::connect(socket.fd(), raw, sizeof(address)) < 0) {
+    if (errno != EINPROGRESS) {
+      check(-errno, "connect");
+    }
+    co_await ReadyAwaiter{socket.waiters.get(), true};
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(socket.fd(), SOL_SOCKET, SO_ERROR, &error, &length);
+    check(-error, "connect");
+  }
+  co_return socket;
+}
+
+struct Listener {
+  // bind(): Listen on host:port; port 0 picks a free one (see port())
+  static Listener bind(const std::string &host, std::uint16_t port,
+                       int backlog = 1024) {
+    Listener listener{Socket(tcp_socket())};
+    int fd = listener.socket.fd();
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = ipv4_address(host, port);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+        listen(fd, backlog) < 0) {
+      throw std::system_error(errno, std::generic_category(), "bind/listen");
+    }
+    return listener;
+  }
+
+  std::uint16_t port() const {
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    getsockname(socket.fd(), reinterpret_cast<sockaddr *>(&address), &length);
+    return ntohs(address.sin_port);
+  }
+
+  // accept(): On io_uring, one multishot accept stays armed between calls
+  // and connections that arrive meanwhile queue up. Kernels before 5.19
+  // reject it (Loop::multishot_accept), and accept() falls back to one
+  // IORING_OP_ACCEPT per call.
+  Task<Socket> accept() {
+    constexpr int flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    Loop &loop = get_global_loop();
+    if (loop.backend() == IoBackend::IoUring && loop.multishot_accept) {
+      if (!accepted) {
+        accepted.reset(new AcceptQueue);
+      }
+      AcceptQueue &queue = *accepted;
+      while (queue.empty() && !queue.rejected()) {
+        if (queue.error) {
+          check(-std::exchange(queue.error, 0), "accept");  // e.g. EMFILE
+        }
+        if (!queue.armed) {
+          queue.arm([&](io_uring_sqe &sqe) {
+            sqe.opcode = IORING_OP_ACCEPT;
+            sqe.fd = socket.fd();
+            sqe.accept_flags = flags;
+            sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+          });
+        }
+        co_await queue.next_cqe();
+      }
+      if (!queue.rejected()) {
+        co_return Socket(queue.take());
+      }
+      loop.multishot_accept = false;
+      accepted.reset();
+    }
+    if (loop.backend() == IoBackend::IoUring) {
+      int fd = check(co_await uring_op([&](io_uring_sqe &sqe) {
+        sqe.opcode = IORING_OP_ACCEPT;
+        sqe.fd = socket.fd();
+        sqe.accept_flags = flags;
+      }), "accept");
+      co_return Socket(fd);
+    }
+    while (true) {
+      int fd = accept4(socket.fd(), nullptr, nullptr, flags);
+      if (fd >= 0) {
+        co_return Socket(fd);
+      }
+      if (!would_block(errno)) {
+        check(-errno, "accept");
+      }
+      co_await ReadyAwaiter{socket.waiters.get(), false};
+    }
+  }
+
+  Socket socket;
+  std::unique_ptr<AcceptQueue, ReleaseMultishot<AcceptQueue>> accepted{};
+};
+
+// ==============================================================================
+// Demo: write a file, then read it sequentially and at random offsets
+// ==============================================================================
+// The file is in the page cache by the time it is read, so the numbers are
+// the cost of getting requests to the kernel and back, which is what the two
+// backends differ in.
+constexpr std::uint64_t file_size = 64ull << 20;
+constexpr std::size_t write_chunk = 1 << 20;
+
+// pattern(): The byte stored at 'offset', so reads can be checked
+std::byte pattern(std::uint64_t offset) {
+  return std::byte((offset / 4096 * 7 + offset % 251) & 0xff);
+}
+
+Task<> writer(const File &file, std::size_t index, std::size_t writers) {
+  std::vector<std::byte> chunk(write_chunk);
+  for (std::uint64_t offset = index * write_chunk; offset < file_size;
+       offset += writers * write_chunk) {
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+      chunk[i] = pattern(offset + i);
+    }
+    std::size_t written = 0;
+    while (written < chunk.size()) {
+      written += co_await async_write(
+          file, offset + written, std::span<const std::byte>(chunk).subspan(written));
+    }
+  }
+}
+
+// sequential_reader(): One coroutine, one large block at a time
+Task<std::size_t> sequential_reader(const File &file, std::size_t block) {
+  std::vector<std::byte> buffer(block);
+  std::size_t mismatches = 0;
+  std::uint64_t offset = 0;
+  while (true) {
+    std::size_t got = co_await async_read(file, offset, buffer);
+    if (got == 0) {
+      break;
+    }
+    mismatches += buffer[0] != pattern(offset);
+    offset += got;
+  }
+  co_return mismatches + (offset != file_size);
+}
+
+// random_reader(): Small reads at random 4 KiB-aligned offsets
+Task<> random_reader(const File &file, std::uint64_t seed, int reads,
+                     std::size_t &mismatches) {
+  std::mt19937_64 random(seed);
+  std::vector<std::byte> buffer(4096);
+  for (int i = 0; i < reads; ++i) {
+    std::uint64_t offset = random() % (file_size / 4096) * 4096;
+    std::size_t got = co_await async_read(file, offset, buffer);
+    mismatches += got != buffer.size() || buffer[17] != pattern(offset + 17);
+  }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void file_benchmark(const std::string &name, const std::string &path) {
+  constexpr std::size_t writers = 8;
+  constexpr std::size_t readers = 32;
+  constexpr int reads_per_reader = 4'000;
+
+  std::cout << name << std::endl;
+  {
+    File file = File::open(path, O_RDWR | O_CREAT | O_TRUNC);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Task<>> tasks;
+    for (std::size_t i = 0; i < writers; ++i) {
+      tasks.push_back(writer(file, i, writers));
+    }
+    run_all(tasks);
+    std::cout << "  write, " << writers << " writers x 1 MiB : "
+              << double(file_size) / (1 << 20) / seconds_since(start) << " MiB/s"
+              << std::endl;
+  }
+
+  File file = File::open(path, O_RDONLY);
+  auto start = std::chrono::steady_clock::now();
+  std::size_t mismatches = run_on_loop(sequential_reader(file, 256 << 10));
+  std::cout << "  sequential read, 256 KiB  : "
+            << double(file_size) / (1 << 20) / seconds_since(start) << " MiB/s"
+            << (mismatches ? ", DATA MISMATCH" : "") << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  mismatches = 0;
+  std::vector<Task<>> tasks;
+  for (std::size_t i = 0; i < readers; ++i) {
+    tasks.push_back(random_reader(file, i + 1, reads_per_reader, mismatches));
+  }
+  run_all(tasks);
+  double reads = double(readers) * reads_per_reader;
+  std::cout << "  random read, 4 KiB x " << readers << "  : "
+            << reads / seconds_since(start) / 1000 << "k reads/s"
+            << (mismatches ? ", DATA MISMATCH" : "") << std::endl;
+}
+
+// ==============================================================================
+// Demo: loopback echo server, connection rate and ping-pong latency
+// ==============================================================================
+// Server and clients share the one Loop thread, so the numbers are the
+// per-operation cost of the backend rather than of a network.
+
+// echo(): Send back whatever arrives, until the client closes
+// - The chunk is sent straight from its pool buffer, which goes back to the
+//   pool before the next receive()
+Task<> echo(Socket client) {
+  try {
+    while (true) {
+      ReceivedBuffer chunk = co_await client.receive();
+      if (chunk.empty()) {
+        break;
+      }
+      co_await client.write_all(chunk.data());
+    }
+  } catch (const std::system_error &) {
+    // reset by the client; nothing to clean up beyond the socket
+  }
+}
+
+// copy_echo(): echo() with read_some() and a buffer per connection
+std::size_t copy_echo_buffers = 0;  // buffers of live copy_echo() calls
+
+Task<> copy_echo(Socket client) {
+  std::vector<std::byte> buffer(4096);
+  ++copy_echo_buffers;
+  try {
+    while (std::size_t got = co_await client.read_some(buffer)) {
+      co_await client.write_all(std::span<const std::byte>(buffer).first(got));
+    }
+  } catch (const std::system_error &) {
+  }
+  --copy_echo_buffers;
+}
+
+// serve(): Accept 'connections' clients, one handler each
+Task<> serve(Listener &listener, std::size_t connections,
+             Task<> (*handler)(Socket) = echo) {
+  for (std::size_t i = 0; i < connections; ++i) {
+    Socket client = co_await listener.accept();
+    spawn(handler(std::move(client)));
+  }
+}
+
+// connect_clients(): Connect, exchange one byte, close; 'count' times
+Task<> connect_clients(std::uint16_t port, std::size_t count) {
+  std::byte byte{42};
+  for (std::size_t i = 0; i < count; ++i) {
+    Socket socket = co_await connect("127.0.0.1", port);
+    co_await socket.write_all(std::span(&byte, 1));
+    if (co_await socket.read_some(std::span(&byte, 1)) != 1) {
+      throw std::runtime_error("connection closed early");
+    }
+  }
+}
+
+// ping_pong(): 'messages' round trips on one connection, timing each
+Task<> ping_pong(std::uint16_t port, std::size_t messages,
+                 std::vector<double> &latencies_us) {
+  Socket socket = co_await connect("127.0.0.1", port);
+  std::vector<std::byte> message(64, std::byte{7});
+  std::vector<std::byte> reply(message.size());
+  for (std::size_t i = 0; i < messages; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    co_await socket.write_all(message);
+    std::size_t got = 0;
+    while (got < reply.size()) {
+      std::size_t n = co_await socket.read_some(std::span(reply).subspan(got));
+      if (n == 0) {
+        throw std::runtime_error("connection closed early");
+      }
+      got += n;
+    }
+    latencies_us.push_back(std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+  }
+}
+
+double percentile(const std::vector<double> &sorted, double fraction) {
+  std::size_t index = std::size_t(fraction * double(sorted.size()));
+  return sorted[std::min(sorted.size() - 1, index)];
+}
+
+void network_benchmark(const std::string &name) {
+  constexpr std::size_t connections = 4'000;
+  constexpr std::size_t connecting_clients = 8;
+  constexpr std::size_t ping_clients = 32;
+  constexpr std::size_t messages = 2'000;
+
+  std::cout << name << std::endl;
+  Listener listener = Listener::bind("127.0.0.1", 0);
+  std::uint16_t port = listener.port();
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Task<>> tasks;
+  tasks.push_back(serve(listener, connections));
+  for (std::size_t i = 0; i < connecting_clients; ++i) {
+    tasks.push_back(connect_clients(port, connections / connecting_clients));
+  }
+  run_all(tasks);
+  std::cout << "  connect + 1-byte echo     : "
+            << double(connections) / seconds_since(start) << " connections/s"
+            << std::endl;
+
+  start = std::chrono::steady_clock::now();
+  std::vector<std::vector<double>> latencies(ping_clients);
+  tasks.clear();
+  tasks.push_back(serve(listener, ping_clients));
+  for (std::size_t i = 0; i < ping_clients; ++i) {
+    tasks.push_back(ping_pong(port, messages, latencies[i]));
+  }
+  run_all(tasks);
+  double elapsed = seconds_since(start);
+
+  std::vector<double> all;
+  for (const std::vector<double> &client : latencies) {
+    all.insert(all.end(), client.begin(), client.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::cout << "  ping-pong, " << ping_clients << " x 64 B      : "
+            << double(all.size()) / elapsed / 1000 << "k messages/s, p50 "
+            << percentile(all, 0.5) << " us, p99 " << percentile(all, 0.99)
+            << " us, p99.9 " << percentile(all, 0.999) << " us" << std::endl;
+}
+
+// ==============================================================================
+// Demo: buffer memory of idle connections
+// ==============================================================================
+// 'clients' connections each send one message in a single burst, get it
+// echoed, and then stay idle. copy_echo() keeps a 4 KiB buffer per
+// connection for the read it is waiting in; echo() holds pool buffers only
+// while a chunk is being echoed, so the pool is sized for the burst rather
+// than for the number of connections.
+
+// burst_then_idle(): Sets 'held' to the buffer bytes the server holds once
+// all 'clients' have had their reply and are idle
+Task<> burst_then_idle(std::uint16_t port, std::size_t clients, bool pooled,
+                       std::size_t &held) {
+  std::vector<Socket> sockets;
+  for (std::size_t i = 0; i < clients; ++i) {
+    sockets.push_back(co_await connect("127.0.0.1", port));
+  }
+  std::vector<std::byte> message(64, std::byte{1});
+  for (Socket &socket : sockets) {
+    co_await socket.write_all(message);
+  }
+  std::vector<std::byte> reply(message.size());
+  for (Socket &socket : sockets) {
+    std::size_t got = 0;
+    while (got < reply.size()) {
+      std::size_t n = co_await socket.read_some(std::span(reply).subspan(got));
+      if (n == 0) {
+        throw std::runtime_error("connection closed early");
+      }
+      got += n;
+    }
+  }
+  BufferPool &pool = get_buffer_pool();
+  held = pooled ? pool.in_use * pool.buffer_size : copy_echo_buffers * 4096;
+}
+
+void idle_connections(const std::string &name) {
+  constexpr std::size_t clients = 4'000;
+  constexpr double mib = 1 << 20;
+
+  std::cout << name << std::endl;
+  BufferPool &pool = get_buffer_pool();
+  for (bool pooled : {false, true}) {
+    Listener listener = Listener::bind("127.0.0.1", 0);
+    pool.peak_in_use = pool.in_use;
+    std::vector<Task<>> tasks;
+    tasks.push_back(serve(listener, clients, pooled ? echo : copy_echo));
+    std::size_t held = 0;
+    tasks.push_back(burst_then_idle(listener.port(), clients, pooled, held));
+    run_all(tasks);
+    if (pooled) {
+      const char *lent = pool.provision == Provision::Ring
+                             ? "provided-buffer ring, an unverified path"
+                         : pool.provision == Provision::ProvideBuffers
+                             ? "IORING_OP_PROVIDE_BUFFERS; the ring failed "
+                               "probe(), so that path is unverified"
+                             : "free list";
+      std::cout << "  receive(), " << pool.count << " x " << pool.buffer_size / 1024
+                << " KiB pool : " << double(held) / mib << " MiB held by " << clients
+                << " idle connections, peak " << pool.peak_in_use
+                << " buffers during the burst (" << lent << ")" << std::endl;
+    } else {
+      std::cout << "  read_some(), 4 KiB each      : " << double(held) / mib
+                << " MiB held by " << clients << " idle connections" << std::endl;
+    }
+  }
+}
+
+int main() {
+  const std::string path = "/tmp/async-io-benchmark.dat";
+  Loop &loop = get_global_loop();
+  if (loop.backend() == IoBackend::IoUring) {
+    file_benchmark("=== Files, io_uring ===", path);
+    network_benchmark("=== Sockets, io_uring ===");
+    idle_connections("=== Idle connections, io_uring ===");
+  } else {
+    std::cout << "io_uring is not available here" << std::endl;
+  }
+  loop.force_fallback = true;
+  file_benchmark("=== Files, thread pool (" + std::to_string(get_io_pool().size()) +
+                     " threads) ===",
+                 path);
+  network_benchmark("=== Sockets, epoll ===");
+  idle_connections("=== Idle connections, epoll ===");
+  unlink(path.c_str());
+  return 0;
+}
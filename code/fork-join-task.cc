@@ -0,0 +1,1187 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ==============================================================================
+// Fork/join coroutines on a work-stealing pool
+// ==============================================================================
+// recursion-task.cc evaluates factorial(n) strictly sequentially: each level
+// co_awaits the next one. For divide-and-conquer work the subproblems are
+// independent, so they can run on different cores:
+//
+//   ForkTask<long> fib(int n) {
+//     ForkTask<long> a = fib(n - 1);
+//     ForkTask<long> b = fib(n - 2);
+//     co_await fork(a);   // a starts running NOW on this thread...
+//     co_await b;         // ...and our continuation (this line) can be stolen
+//     co_await join();    // wait until every forked child has finished
+//     co_return a.result() + b.result();
+//   }
+//
+// Continuation stealing (the "work-first" strategy of Cilk):
+// - fork(child) pushes the PARENT's continuation onto this worker's deque and
+//   symmetric-transfers into the child, so the child runs exactly like a
+//   plain call would
+// - An idle worker steals the oldest continuation from another deque and
+//   resumes the parent there, in parallel with the child
+// - When the child finishes and its parent was not stolen, it pops the parent
+//   back off its own deque and continues it: no other thread was involved
+// - join() suspends the parent until all its forked children are done; the
+//   last child to finish resumes it
+//
+// Join counting: 'pending' starts at 1, the parent's own token. fork() adds 1
+// per child and each finished child subtracts 1. join() gives up the parent's
+// token: whoever brings the counter to 0 (join itself, or the last child)
+// continues the parent, and resets the counter to 1 for the next round.
+
+struct Worker;
+thread_local Worker *current_worker = nullptr;
+
+// RootSignal: Tells ForkJoinPool::run() that its root task has finished
+// - Signalled under the mutex: once the worker unlocks, run() may return and
+//   destroy both this object and the root frame, so the worker must not
+//   touch either afterwards
+struct RootSignal {
+  void notify() {
+    std::lock_guard lock(mutex);
+    done = true;
+    finished.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [this] { return done; });
+  }
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool done{false};
+};
+
+// ==============================================================================
+// ForkPromiseBase: Scheduling state shared by every ForkPromise<T>
+// ==============================================================================
+struct ForkPromiseBase {
+  // handle: This coroutine (set in get_return_object)
+  std::coroutine_handle<> handle;
+
+  // parent: Who called or forked us (nullptr for the root task)
+  ForkPromiseBase *parent{nullptr};
+
+  // forked: Started by fork() (parent may be stolen) or by co_await (not)
+  bool forked{false};
+
+  // pending: Forked children still running, plus 1 for the parent itself
+  std::atomic<int> pending{1};
+
+  // root_done: Set by ForkJoinPool::run() for the root task
+  RootSignal *root_done{nullptr};
+};
+
+// ==============================================================================
+// WorkQueue: One worker's deque of runnable coroutines
+// ==============================================================================
+// The owner pushes and pops at the back (newest first, good locality); thieves
+// take from the front (oldest first, which in a recursion is the biggest
+// remaining piece of work). A mutex keeps it simple; a lock-free Chase-Lev
+// deque is the usual next step once the lock shows up in profiles.
+struct WorkQueue {
+  void push_back(std::coroutine_handle<> handle) {
+    std::lock_guard lock(mutex);
+    items.push_back(handle);
+  }
+
+  std::coroutine_handle<> pop_back() {
+    std::lock_guard lock(mutex);
+    if (items.empty()) {
+      return nullptr;
+    }
+    auto handle = items.back();
+    items.pop_back();
+    return handle;
+  }
+
+  // pop_back_if(): Take 'handle' back, unless a thief already took it
+  bool pop_back_if(std::coroutine_handle<> handle) {
+    std::lock_guard lock(mutex);
+    if (items.empty() || items.back() != handle) {
+      return false;
+    }
+    items.pop_back();
+    return true;
+  }
+
+  std::coroutine_handle<> steal_front() {
+    std::lock_guard lock(mutex);
+    if (items.empty()) {
+      return nullptr;
+    }
+    auto handle = items.front();
+    items.pop_front();
+    return handle;
+  }
+
+  std::mutex mutex;
+  std::deque<std::coroutine_handle<>> items;
+};
+
+struct Worker {
+  WorkQueue queue;
+  std::size_t index;
+  std::atomic<std::size_t> steals{0};
+};
+
+// ==============================================================================
+// ForkJoinPool: Worker threads that run and steal coroutines
+// ==============================================================================
+struct ForkJoinPool {
+  explicit ForkJoinPool(std::size_t thread_count) {
+    for (std::size_t i = 0; i < thread_count; ++i) {
+      workers.push_back(std::make_unique<Worker>());
+      workers.back()->index = i;
+    }
+    for (std::size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back([this, i] { work(*workers[i]); });
+    }
+  }
+
+  ~ForkJoinPool() {
+    stopping.store(true, std::memory_order_release);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // run(): Start 'root' on the pool and block until it has finished
+  template <typename TaskType> decltype(auto) run(TaskType &root) {
+    RootSignal done;
+    root.coroutine.promise().root_done = &done;
+    add_task(root.coroutine);
+    done.wait();
+    return root.result();
+  }
+
+  // add_task(): Schedule a coroutine from outside the pool
+  void add_task(std::coroutine_handle<> handle) {
+    std::size_t index = next_injection.fetch_add(1, std::memory_order_relaxed);
+    workers[index % workers.size()]->queue.push_back(handle);
+  }
+
+  std::size_t steals() const {
+    std::size_t total = 0;
+    for (auto &worker : workers) {
+      total += worker->steals.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  std::size_t size() const { return workers.size(); }
+
+private:
+  // work(): Worker loop - own deque first, then steal, then back off
+  void work(Worker &self) {
+    current_worker = &self;
+    std::minstd_rand random(static_cast<unsigned>(self.index) + 1);
+    int idle_rounds = 0;
+
+    while (!stopping.load(std::memory_order_acquire)) {
+      std::coroutine_handle<> handle = self.queue.pop_back();
+      if (!handle && workers.size() > 1) {
+        std::size_t victim = random() % workers.size();
+        if (victim != self.index) {
+          handle = workers[victim]->queue.steal_front();
+          if (handle) {
+            self.steals.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }
+
+      if (handle) {
+        idle_rounds = 0;
+        handle.resume();  // runs until the chain of transfers reaches noop
+      } else if (++idle_rounds < 64) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+    current_worker = nullptr;
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<bool> stopping{false};
+  std::atomic<std::size_t> next_injection{0};
+};
+
+// ==============================================================================
+// ForkFinalAwaiter: Where a finished ForkTask goes next
+// ==============================================================================
+struct ForkFinalAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  template <typename P>
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<P> finished) noexcept {
+    ForkPromiseBase &promise = finished.promise();
+    assert(promise.pending.load() == 1 && "forked children must be joined");
+
+    ForkPromiseBase *parent = promise.parent;
+    if (!parent) {
+      // Root task: wake up ForkJoinPool::run()
+      promise.root_done->notify();
+      return std::noop_coroutine();
+    }
+    if (!promise.forked) {
+      return parent->handle;  // plain co_await: return like a normal call
+    }
+
+    // Forked and the parent is still on our deque: nobody stole it, so just
+    // continue it here. The parent still holds its token, so the counter
+    // cannot reach 0.
+    if (current_worker && current_worker->queue.pop_back_if(parent->handle)) {
+      parent->pending.fetch_sub(1, std::memory_order_release);
+      return parent->handle;
+    }
+
+    // The parent was stolen. If it is already waiting in join() and we are
+    // the last child, we continue it; otherwise back to the worker loop.
+    if (parent->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      parent->pending.store(1, std::memory_order_relaxed);
+      return parent->handle;
+    }
+    return std::noop_coroutine();
+  }
+
+  void await_resume() noexcept {}
+};
+
+// ==============================================================================
+// ForkPromise / ForkTask
+// ==============================================================================
+template <typename T> struct ForkResult {
+  void return_value(T val) { value = std::move(val); }
+
+  T &result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return *value;
+  }
+
+  std::optional<T> value{std::nullopt};
+  std::exception_ptr exception{nullptr};
+};
+
+template <> struct ForkResult<void> {
+  void return_void() {}
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  std::exception_ptr exception{nullptr};
+};
+
+template <typename T> struct ForkPromise : ForkPromiseBase, ForkResult<T> {
+
+  // initial_suspend(): Lazy; started by fork(), co_await or the pool
+  auto initial_suspend() noexcept { return std::suspend_always{}; }
+
+  auto final_suspend() noexcept { return ForkFinalAwaiter{}; }
+
+  void unhandled_exception() { this->exception = std::current_exception(); }
+
+  std::coroutine_handle<ForkPromise> get_return_object() {
+    auto coroutine = std::coroutine_handle<ForkPromise>::from_promise(*this);
+    handle = coroutine;
+    return coroutine;
+  }
+};
+
+template <typename T = void> struct ForkTask {
+  using promise_type = ForkPromise<T>;
+
+  ForkTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  ForkTask(const ForkTask &) = delete;
+  ForkTask &operator=(const ForkTask &) = delete;
+
+  ForkTask(ForkTask &&other) noexcept
+      : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  ForkTask &operator=(ForkTask &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~ForkTask() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  // CallAwaiter: co_await task - run it inline, like CalleeAwaiter
+  struct CallAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept {
+      coroutine.promise().parent = &caller.promise();
+      coroutine.promise().forked = false;
+      return coroutine;
+    }
+
+    decltype(auto) await_resume() { return coroutine.promise().result(); }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  CallAwaiter operator co_await() { return CallAwaiter{coroutine}; }
+
+  // result(): The value, once the task has been joined (rethrows exceptions)
+  decltype(auto) result() { return coroutine.promise().result(); }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// ==============================================================================
+// fork() / join()
+// ==============================================================================
+// ForkAwaiter: Run the child now, leave our continuation up for stealing
+struct ForkAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  template <typename P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent) noexcept {
+    child.parent = &parent.promise();
+    child.forked = true;
+    parent.promise().pending.fetch_add(1, std::memory_order_relaxed);
+    current_worker->queue.push_back(parent);
+    return child.handle;
+  }
+
+  void await_resume() noexcept {}
+
+  ForkPromiseBase &child;
+};
+
+template <typename T> ForkAwaiter fork(ForkTask<T> &task) {
+  assert(current_worker && "fork() must run on a ForkJoinPool worker");
+  return ForkAwaiter{task.coroutine.promise()};
+}
+
+// JoinAwaiter: Wait until every child forked so far has finished
+struct JoinAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  // await_suspend(): false = everything already done, keep running
+  template <typename P> bool await_suspend(std::coroutine_handle<P> parent) noexcept {
+    ForkPromiseBase &promise = parent.promise();
+    if (promise.pending.load(std::memory_order_acquire) == 1) {
+      return false;
+    }
+    if (promise.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      promise.pending.store(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;  // the last child resumes us
+  }
+
+  void await_resume() noexcept {}
+};
+
+JoinAwaiter join() { return JoinAwaiter{}; }
+
+// ==============================================================================
+// Parallel fibonacci
+// ==============================================================================
+// Below 'cutoff' a plain function is faster than any task, so recursion
+// switches to it; above, fib(n-1) is forked and fib(n-2) runs inline.
+//
+// If the inline child throws, join() must still run before the exception
+// leaves the frame: the forked child holds a pointer to this promise and
+// decrements its 'pending' when it finishes.
+long fib_serial(int n) { return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2); }
+
+ForkTask<long> fib(int n, int cutoff) {
+  if (n < cutoff) {
+    co_return fib_serial(n);
+  }
+  ForkTask<long> a = fib(n - 1, cutoff);
+  ForkTask<long> b = fib(n - 2, cutoff);
+  co_await fork(a);
+  std::exception_ptr failure;
+  try {
+    co_await b;
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  co_await join();
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  co_return a.result() + b.result();
+}
+
+template <typename F> double seconds(F &&body) {
+  auto start = std::chrono::steady_clock::now();
+  body();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void fib_benchmark() {
+  constexpr int n = 36;
+  constexpr int cutoff = 20;
+
+  long expected = 0;
+  double serial = seconds([&] { expected = fib_serial(n); });
+  std::cout << "fib(" << n << ") serial: " << expected << " in " << serial
+            << " s" << std::endl;
+
+  std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t threads = 1; threads <= std::max<std::size_t>(cores, 4);
+       threads *= 2) {
+    ForkJoinPool pool(threads);
+    long value = 0;
+    double elapsed = seconds([&] {
+      ForkTask<long> root = fib(n, cutoff);
+      value = pool.run(root);
+    });
+    std::cout << "fib(" << n << ") on " << threads << " thread(s): " << value
+              << " in " << elapsed << " s, speedup " << serial / elapsed
+              << ", steals " << pool.steals()
+              << (value == expected ? "" : "  WRONG") << std::endl;
+  }
+}
+
+// ==============================================================================
+// BigInt: Unsigned arbitrary-precision integer for the product-tree factorial
+// ==============================================================================
+// recursion-task.cc computes factorial(n) as an int, which overflows at 13!.
+// Here n! is split into a balanced product tree:
+//
+//   n! = product(1, n)
+//   product(lo, hi) = product(lo, mid) * product(mid + 1, hi)
+//
+// - Each node is a ForkTask: the left half is forked, the right half is run
+//   inline, and the two partial products are multiplied after join()
+// - Both operands of a node have about the same size, so the expensive
+//   multiplications happen near the root between two large numbers, where
+//   Karatsuba pays off; left-to-right multiplication would instead do n
+//   (huge x small) products
+// - Leaves multiply a short run of consecutive integers serially
+//
+// Limbs are 32 bits, least significant first, with no leading zero limbs
+// (zero is the empty vector), so a limb product fits in a uint64_t.
+using Limb = std::uint32_t;
+using Limbs = std::vector<Limb>;
+
+void trim(Limbs &limbs) {
+  while (!limbs.empty() && limbs.back() == 0) {
+    limbs.pop_back();
+  }
+}
+
+// ==============================================================================
+// Limb multiplication kernels: out[0, na + nb) = a * b
+// ==============================================================================
+using MulKernel = void (*)(const Limb *a, std::size_t na, const Limb *b,
+                           std::size_t nb, Limb *out);
+
+// mul_scalar(): Schoolbook, one row per limb of a, carry kept in a uint64_t
+// - (2^32 - 1)^2 + 2 * (2^32 - 1) == 2^64 - 1, so 'product + out + carry'
+//   never overflows
+void mul_scalar(const Limb *a, std::size_t na, const Limb *b, std::size_t nb,
+                Limb *out) {
+  std::fill(out, out + na + nb, 0);
+  for (std::size_t i = 0; i < na; ++i) {
+    std::uint64_t carry = 0;
+    for (std::size_t j = 0; j < nb; ++j) {
+      std::uint64_t t = std::uint64_t(a[i]) * b[j] + out[i + j] + carry;
+      out[i + j] = Limb(t);
+      carry = t >> 32;
+    }
+    out[i + nb] = Limb(carry);
+  }
+}
+
+#if defined(__x86_64__)
+// mul_avx2(): Schoolbook with four 32x32->64 products per instruction
+// - Product scanning: the outer loop walks the output four columns at a
+//   time, and column k sums a[i] * b[k - i] over the rows i that reach it.
+//   The four b limbs a row needs are one contiguous load from a zero-padded
+//   copy of b on the stack, so a block's sum stays in two registers and
+//   'out' is written once, with no scratch memory per call
+// - The carry chain is what keeps the scalar loop serial, so it is deferred:
+//   each 64-bit product is split into its low and high halves, summed in
+//   separate 64-bit lanes; the high half belongs to the next column
+// - A column receives at most min(na, nb) halves below 2^32, so the sums
+//   cannot overflow; one scalar carry pass per block writes the limbs
+// - The padded copy holds the shorter operand, up to mul_avx2_max_short
+//   limbs; multiply() only sends operands below karatsuba_threshold here,
+//   anything longer falls back to mul_scalar()
+// - Compiled for AVX2 through the target attribute, so the rest of the file
+//   still builds for baseline x86-64; mul_kernel() only picks it when the
+//   CPU supports it
+constexpr std::size_t mul_avx2_max_short = 64;
+
+__attribute__((target("avx2"))) void mul_avx2(const Limb *a, std::size_t na,
+                                              const Limb *b, std::size_t nb,
+                                              Limb *out) {
+  if (na < nb) {
+    std::swap(a, b);
+    std::swap(na, nb);
+  }
+  if (nb == 0 || nb > mul_avx2_max_short) {
+    mul_scalar(a, na, b, nb, out);
+    return;
+  }
+
+  // padded[3 + j] = b[j], zero for j in [-3, 0) and [nb, nb + 4)
+  Limb padded[3 + mul_avx2_max_short + 4] = {};
+  std::copy(b, b + nb, padded + 3);
+
+  const std::size_t columns = na + nb - 1;  // the top limb is carry only
+  const __m256i low_mask = _mm256_set1_epi64x(0xffffffff);
+  std::uint64_t carry = 0;
+  std::uint64_t owed_high = 0;  // high halves of the previous column
+  for (std::size_t k = 0; k < columns; k += 4) {
+    // Rows that reach columns k..k+3: k - nb < i <= k + 3
+    std::size_t first = k + 1 > nb ? k + 1 - nb : 0;
+    std::size_t last = std::min(na - 1, k + 3);
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+    for (std::size_t i = first; i <= last; ++i) {
+      __m256i bk = _mm256_cvtepu32_epi64(_mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(padded + 3 + k - i)));
+      __m256i product = _mm256_mul_epu32(_mm256_set1_epi64x(a[i]), bk);
+      low = _mm256_add_epi64(low, _mm256_and_si256(product, low_mask));
+      high = _mm256_add_epi64(high, _mm256_srli_epi64(product, 32));
+    }
+
+    alignas(32) std::uint64_t lows[4], highs[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lows), low);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(highs), high);
+    for (std::size_t t = 0; t < 4 && k + t < columns; ++t) {
+      std::uint64_t column = lows[t] + owed_high + carry;
+      out[k + t] = Limb(column);
+      carry = column >> 32;
+      owed_high = highs[t];
+    }
+  }
+  out[columns] = Limb(owed_high + carry);
+}
+#endif
+
+// mul_kernel(): The schoolbook kernel for this CPU, chosen once at startup
+// - 'force_scalar' is for the benchmark and for cross-checking the kernels
+bool force_scalar = false;
+
+MulKernel mul_kernel() {
+#if defined(__x86_64__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2 && !force_scalar) {
+    return mul_avx2;
+  }
+#endif
+  return mul_scalar;
+}
+
+// ==============================================================================
+// Karatsuba
+// ==============================================================================
+// a = a1 * B^m + a0, b = b1 * B^m + b0 (B = 2^32):
+//
+//   a * b = z2 * B^2m + z1 * B^m + z0
+//   z0 = a0 * b0,  z2 = a1 * b1,  z1 = (a0 + a1)(b0 + b1) - z0 - z2
+//
+// Three half-size products instead of four. Below 'karatsuba_threshold' limbs
+// the extra additions cost more than they save and the schoolbook kernel
+// takes over.
+constexpr std::size_t karatsuba_threshold = 48;
+
+Limbs add(std::span<const Limb> a, std::span<const Limb> b) {
+  if (a.size() < b.size()) {
+    std::swap(a, b);
+  }
+  Limbs sum(a.size() + 1);
+  std::uint64_t carry = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    carry += std::uint64_t(a[i]) + (i < b.size() ? b[i] : 0);
+    sum[i] = Limb(carry);
+    carry >>= 32;
+  }
+  sum[a.size()] = Limb(carry);
+  trim(sum);
+  return sum;
+}
+
+// subtract_in_place(): a -= b, requires a >= b
+void subtract_in_place(Limbs &a, const Limbs &b) {
+  std::int64_t borrow = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    std::int64_t difference =
+        std::int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+    borrow = difference < 0;
+    a[i] = Limb(difference + (borrow << 32));
+  }
+  trim(a);
+}
+
+// add_shifted(): acc += x * B^shift, acc is already long enough
+void add_shifted(Limbs &acc, const Limbs &x, std::size_t shift) {
+  std::uint64_t carry = 0;
+  std::size_t i = 0;
+  for (; i < x.size(); ++i) {
+    carry += std::uint64_t(acc[shift + i]) + x[i];
+    acc[shift + i] = Limb(carry);
+    carry >>= 32;
+  }
+  for (std::size_t k = shift + i; carry != 0; ++k) {
+    carry += acc[k];
+    acc[k] = Limb(carry);
+    carry >>= 32;
+  }
+}
+
+Limbs multiply(std::span<const Limb> a, std::span<const Limb> b) {
+  if (a.size() < b.size()) {
+    std::swap(a, b);
+  }
+  if (b.empty()) {
+    return {};
+  }
+
+  Limbs product(a.size() + b.size(), 0);
+  if (b.size() < karatsuba_threshold) {
+    mul_kernel()(a.data(), a.size(), b.data(), b.size(), product.data());
+    trim(product);
+    return product;
+  }
+
+  // Unbalanced: cut a into b-sized pieces, each piece is a balanced product
+  if (a.size() >= 2 * b.size()) {
+    for (std::size_t offset = 0; offset < a.size(); offset += b.size()) {
+      auto piece = a.subspan(offset, std::min(b.size(), a.size() - offset));
+      add_shifted(product, multiply(piece, b), offset);
+    }
+    trim(product);
+    return product;
+  }
+
+  // Balanced: b.size() > m, so both high halves are non-empty
+  std::size_t m = a.size() / 2;
+  auto a0 = a.first(m), a1 = a.subspan(m);
+  auto b0 = b.first(m), b1 = b.subspan(m);
+
+  Limbs z0 = multiply(a0, b0);
+  Limbs z2 = multiply(a1, b1);
+  Limbs z1 = multiply(add(a0, a1), add(b0, b1));
+  subtract_in_place(z1, z0);
+  subtract_in_place(z1, z2);
+
+  add_shifted(product, z0, 0);
+  add_shifted(product, z1, m);
+  add_shifted(product, z2, 2 * m);
+  trim(product);
+  return product;
+}
+
+struct BigInt {
+  BigInt() = default;
+
+  explicit BigInt(std::uint64_t value) {
+    for (; value != 0; value >>= 32) {
+      limbs.push_back(Limb(value));
+    }
+  }
+
+  friend BigInt operator*(const BigInt &a, const BigInt &b) {
+    BigInt product;
+    product.limbs = multiply(a.limbs, b.limbs);
+    return product;
+  }
+
+  // multiply_small(): *this *= factor, the inner loop of the leaves
+  void multiply_small(Limb factor) {
+    std::uint64_t carry = 0;
+    for (Limb &limb : limbs) {
+      carry += std::uint64_t(limb) * factor;
+      limb = Limb(carry);
+      carry >>= 32;
+    }
+    if (carry != 0) {
+      limbs.push_back(Limb(carry));
+    }
+    if (factor == 0) {
+      limbs.clear();
+    }
+  }
+
+  // to_string(): Decimal, by repeated division by 10^9 (quadratic)
+  std::string to_string() const {
+    if (limbs.empty()) {
+      return "0";
+    }
+    Limbs rest = limbs;
+    std::vector<Limb> groups;  // base 10^9 digits, least significant first
+    while (!rest.empty()) {
+      std::uint64_t remainder = 0;
+      for (std::size_t i = rest.size(); i-- > 0;) {
+        std::uint64_t current = (remainder << 32) | rest[i];
+        rest[i] = Limb(current / 1'000'000'000);
+        remainder = current % 1'000'000'000;
+      }
+      groups.push_back(Limb(remainder));
+      trim(rest);
+    }
+    std::string text = std::to_string(groups.back());
+    for (std::size_t i = groups.size() - 1; i-- > 0;) {
+      std::string group = std::to_string(groups[i]);
+      text += std::string(9 - group.size(), '0') + group;
+    }
+    return text;
+  }
+
+  bool operator==(const BigInt &) const = default;
+
+  std::size_t bits() const {
+    return limbs.empty() ? 0
+                         : 32 * limbs.size() - std::countl_zero(limbs.back());
+  }
+
+  Limbs limbs;
+};
+
+// ==============================================================================
+// Product-tree factorial
+// ==============================================================================
+// range_product(): lo * (lo + 1) * ... * hi, one small factor at a time
+BigInt range_product(std::uint32_t lo, std::uint32_t hi) {
+  BigInt product(1);
+  for (std::uint32_t k = lo; k <= hi; ++k) {
+    product.multiply_small(k);
+  }
+  return product;
+}
+
+// product_tree(): The same split, but on the pool
+// - 'leaf': ranges shorter than this are multiplied serially
+ForkTask<BigInt> product_tree(std::uint32_t lo, std::uint32_t hi,
+                              std::uint32_t leaf) {
+  if (hi - lo < leaf) {
+    co_return range_product(lo, hi);
+  }
+  std::uint32_t mid = lo + (hi - lo) / 2;
+  ForkTask<BigInt> left = product_tree(lo, mid, leaf);
+  ForkTask<BigInt> right = product_tree(mid + 1, hi, leaf);
+  co_await fork(left);
+  std::exception_ptr failure;  // e.g. bad_alloc; join() first, as in fib()
+  try {
+    co_await right;
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  co_await join();
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  co_return left.result() * right.result();
+}
+
+// product_tree_serial(): The reference, the same tree without any tasks
+BigInt product_tree_serial(std::uint32_t lo, std::uint32_t hi,
+                           std::uint32_t leaf) {
+  if (hi - lo < leaf) {
+    return range_product(lo, hi);
+  }
+  std::uint32_t mid = lo + (hi - lo) / 2;
+  return product_tree_serial(lo, mid, leaf) *
+         product_tree_serial(mid + 1, hi, leaf);
+}
+
+void factorial_benchmark() {
+  constexpr std::uint32_t leaf = 32;
+
+  // 25! does not fit in 64 bits, let alone in recursion-task.cc's int
+  {
+    ForkJoinPool pool(2);
+    ForkTask<BigInt> root = product_tree(1, 25, 4);
+    std::cout << "25! = " << pool.run(root).to_string() << std::endl;
+  }
+
+  // Kernels: AVX2 and scalar schoolbook, and Karatsuba, must all agree
+  {
+    BigInt a = range_product(1, 3000), b = range_product(3001, 5000);
+    force_scalar = true;
+    BigInt scalar = a * b;
+    Limbs schoolbook(a.limbs.size() + b.limbs.size());
+    mul_scalar(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size(),
+               schoolbook.data());
+    trim(schoolbook);
+    force_scalar = false;
+    BigInt simd = a * b;
+    bool agree = scalar == simd && scalar.limbs == schoolbook &&
+                 simd == range_product(1, 5000);
+    std::cout << "kernels agree on 5000!: " << (agree ? "yes" : "NO")
+              << std::endl;
+
+    // The kernel alone, at the largest size multiply() hands to it
+    Limbs x(karatsuba_threshold - 1, 0x9e3779b9), y(x.size(), 0x7f4a7c15);
+    Limbs out(x.size() + y.size());
+    constexpr int calls = 100'000;
+    for (bool scalar_kernel : {true, false}) {
+      force_scalar = scalar_kernel;
+      MulKernel kernel = mul_kernel();
+      double elapsed = seconds([&] {
+        for (int call = 0; call < calls; ++call) {
+          kernel(x.data(), x.size(), y.data(), y.size(), out.data());
+        }
+      });
+      std::cout << "schoolbook " << x.size() << "x" << y.size() << " limbs ["
+                << (scalar_kernel ? "scalar" : "simd  ") << "]: "
+                << elapsed / calls * 1e9 << " ns" << std::endl;
+    }
+    force_scalar = false;
+  }
+
+  // Stress: heavy CPU per task and a deep tree
+  constexpr std::uint32_t n = 100'000;
+  for (bool scalar : {true, false}) {
+    force_scalar = scalar;
+    const char *kernel = scalar ? "scalar" : "simd  ";
+
+    BigInt expected;
+    double serial = seconds([&] { expected = product_tree_serial(1, n, leaf); });
+    std::cout << n << "! [" << kernel << "] serial: " << expected.bits()
+              << " bits in " << serial << " s" << std::endl;
+
+    std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t threads = 1; threads <= std::max<std::size_t>(cores, 4);
+         threads *= 2) {
+      ForkJoinPool pool(threads);
+      BigInt value;
+      double elapsed = seconds([&] {
+        ForkTask<BigInt> root = product_tree(1, n, leaf);
+        value = pool.run(root);
+      });
+      std::cout << n << "! [" << kernel << "] on " << threads
+                << " thread(s): " << elapsed << " s, speedup "
+                << serial / elapsed << ", steals " << pool.steals()
+                << (value == expected ? "" : "  WRONG") << std::endl;
+    }
+  }
+  force_scalar = false;
+}
+
+// ==============================================================================
+// parallel_for / parallel_reduce
+// ==============================================================================
+// Batch loops on the pool, written as coroutines so they can be co_await'ed
+// from other tasks instead of blocking a thread like std::for_each(par, ...):
+//
+//   co_await parallel_for(items, grain, [](Item &item) { ... });
+//   double total = co_await parallel_reduce(values, 0.0, std::plus<>{});
+//
+// The range is halved recursively (fork the left half, run the right half
+// inline, join) until a piece has at most 'grain' items, which then run in a
+// plain loop. The grain is either a fixed item count or an AdaptiveGrain.
+
+// FixedGrain: A leaf has at most 'items' items
+struct FixedGrain {
+  static constexpr bool timed = false;
+
+  std::size_t size() const { return items; }
+  void record(std::size_t /*items*/, double /*elapsed_ns*/) {}
+
+  std::size_t items;
+};
+
+// AdaptiveGrain: Sizes leaves so each one takes about 'target'
+// - Every leaf measures itself and feeds ns-per-item into a moving average;
+//   the next split decisions read it, so cheap items end up in big leaves
+//   and expensive ones in small leaves without any tuning by the caller
+// - Before the first measurement the grain is 1: the work-first order runs
+//   the leftmost leaf before almost anything else has been split, so only a
+//   few tiny leaves are created before the estimate exists
+// - Reusing one AdaptiveGrain across calls keeps what was learned; the
+//   average is updated with relaxed atomics, and a sample lost to a race
+//   between two leaves does not matter
+struct AdaptiveGrain {
+  static constexpr bool timed = true;
+  static constexpr std::size_t max_items = std::size_t(1) << 20;
+
+  explicit AdaptiveGrain(
+      std::chrono::nanoseconds target = std::chrono::microseconds(50))
+      : target_ns(double(target.count())) {}
+
+  std::size_t size() const {
+    double per_item = ns_per_item.load(std::memory_order_relaxed);
+    if (per_item <= 0) {
+      return 1;
+    }
+    return std::clamp<std::size_t>(std::size_t(target_ns / per_item), 1,
+                                   max_items);
+  }
+
+  void record(std::size_t items, double elapsed_ns) {
+    double sample = std::max(elapsed_ns, 1.0) / double(items);
+    double average = ns_per_item.load(std::memory_order_relaxed);
+    ns_per_item.store(average <= 0 ? sample : average + (sample - average) / 4,
+                      std::memory_order_relaxed);
+  }
+
+  double target_ns;
+  std::atomic<double> ns_per_item{0};
+};
+
+// run_leaf(): Runs one leaf, timing it if the grain wants to know
+template <typename Grain, typename Body>
+decltype(auto) run_leaf(Grain &grain, std::size_t items, Body &&body) {
+  if constexpr (Grain::timed) {
+    auto start = std::chrono::steady_clock::now();
+    struct Record {
+      ~Record() {
+        grain.record(items, std::chrono::duration<double, std::nano>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+      }
+      Grain &grain;
+      std::size_t items;
+      std::chrono::steady_clock::time_point start;
+    } record{grain, items, start};
+    return body();
+  } else {
+    return body();
+  }
+}
+
+// for_pieces(): The recursion behind parallel_for
+// - 'fn' and 'grain' live in the frame of the outer parallel_for coroutine,
+//   which stays suspended until every piece has finished
+template <typename It, typename Fn, typename Grain>
+ForkTask<> for_pieces(It first, std::size_t count, Fn &fn, Grain &grain) {
+  if (count <= grain.size()) {
+    run_leaf(grain, count, [&] {
+      for (std::size_t i = 0; i < count; ++i) {
+        fn(first[i]);
+      }
+    });
+    co_return;
+  }
+  std::size_t half = count / 2;
+  ForkTask<> left = for_pieces(first, half, fn, grain);
+  ForkTask<> right = for_pieces(first + half, count - half, fn, grain);
+  co_await fork(left);
+  std::exception_ptr failure;  // join() first, as in fib()
+  try {
+    co_await right;
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  co_await join();
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  left.result();  // rethrow anything the forked half threw
+}
+
+// reduce_pieces(): The recursion behind parallel_reduce
+// - A leaf folds its items starting from its first item, so 'op' needs to be
+//   associative but no identity element is required (count is never 0)
+template <typename T, typename It, typename Op, typename Grain>
+ForkTask<T> reduce_pieces(It first, std::size_t count, Op &op, Grain &grain) {
+  if (count <= grain.size()) {
+    co_return run_leaf(grain, count, [&] {
+      T value = first[0];
+      for (std::size_t i = 1; i < count; ++i) {
+        value = op(std::move(value), first[i]);
+      }
+      return value;
+    });
+  }
+  std::size_t half = count / 2;
+  ForkTask<T> left = reduce_pieces<T>(first, half, op, grain);
+  ForkTask<T> right = reduce_pieces<T>(first + half, count - half, op, grain);
+  co_await fork(left);
+  std::exception_ptr failure;
+  try {
+    co_await right;
+  } catch (...) {
+    failure = std::current_exception();
+  }
+  co_await join();
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  co_return op(std::move(left.result()), std::move(right.result()));
+}
+
+template <typename View, typename Fn, typename Grain>
+ForkTask<> parallel_for_view(View view, Grain &grain, Fn fn) {
+  co_await for_pieces(std::ranges::begin(view), std::ranges::size(view), fn,
+                      grain);
+}
+
+template <typename View, typename Fn>
+ForkTask<> parallel_for_view(View view, FixedGrain grain, Fn fn) {
+  co_await for_pieces(std::ranges::begin(view), std::ranges::size(view), fn,
+                      grain);
+}
+
+template <typename T, typename View, typename Op>
+ForkTask<T> parallel_reduce_view(View view, T init, Op op, AdaptiveGrain *grain) {
+  std::size_t count = std::ranges::size(view);
+  if (count == 0) {
+    co_return init;
+  }
+  AdaptiveGrain local;
+  AdaptiveGrain &used = grain ? *grain : local;
+  co_return op(std::move(init),
+               co_await reduce_pieces<T>(std::ranges::begin(view), count, op,
+                                         used));
+}
+
+// parallel_for(range, grain, fn): fn(item) for every item of the range
+// - 'grain' is an item count (FixedGrain) or an AdaptiveGrain that must
+//   outlive the task
+// - The range is turned into a view right away (not when the lazy task
+//   starts), so a temporary container is moved into the task instead of
+//   dangling
+template <std::ranges::random_access_range Range, typename Fn>
+  requires std::ranges::sized_range<Range> && std::ranges::viewable_range<Range>
+ForkTask<> parallel_for(Range &&range, std::size_t grain, Fn fn) {
+  return parallel_for_view(std::views::all(std::forward<Range>(range)),
+                           FixedGrain{std::max<std::size_t>(grain, 1)},
+                           std::move(fn));
+}
+
+template <std::ranges::random_access_range Range, typename Fn>
+  requires std::ranges::sized_range<Range> && std::ranges::viewable_range<Range>
+ForkTask<> parallel_for(Range &&range, AdaptiveGrain &grain, Fn fn) {
+  return parallel_for_view(std::views::all(std::forward<Range>(range)), grain,
+                           std::move(fn));
+}
+
+// parallel_reduce(range, init, op[, grain]): op(init, op(op(a, b), ...))
+// - Without a grain, a fresh AdaptiveGrain is used for this call
+template <std::ranges::random_access_range Range, typename T, typename Op>
+  requires std::ranges::sized_range<Range> && std::ranges::viewable_range<Range>
+ForkTask<T> parallel_reduce(Range &&range, T init, Op op,
+                            AdaptiveGrain *grain = nullptr) {
+  return parallel_reduce_view(std::views::all(std::forward<Range>(range)),
+                              std::move(init), std::move(op), grain);
+}
+
+// ==============================================================================
+// Demo: adaptive grain on cheap and expensive items
+// ==============================================================================
+// busy_work(): About 'rounds' dependent floating-point operations
+double busy_work(double x, int rounds) {
+  for (int i = 0; i < rounds; ++i) {
+    x = x * 0.999999 + 1e-9;
+  }
+  return x;
+}
+
+ForkTask<double> analytics(std::vector<double> &values, AdaptiveGrain &cheap,
+                           AdaptiveGrain &expensive) {
+  // Cheap items: one multiply each
+  co_await parallel_for(values, cheap, [](double &v) { v = v * 2; });
+
+  // Expensive items: a few microseconds each
+  std::vector<double> scores(values.size() / 64);
+  co_await parallel_for(std::views::iota(std::size_t(0), scores.size()),
+                        expensive, [&](std::size_t i) {
+                          scores[i] = busy_work(values[i], 2000);
+                        });
+
+  double sum = co_await parallel_reduce(values, 0.0, std::plus<>{});
+  double best = co_await parallel_reduce(
+      scores, 0.0, [](double a, double b) { return std::max(a, b); });
+  co_return sum + best;
+}
+
+void parallel_for_demo() {
+  std::vector<double> values(2'000'000);
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = double(i % 1000);
+  }
+
+  double expected_sum = 0;
+  for (double v : values) {
+    expected_sum += v * 2;
+  }
+  double expected_best = 0;
+  for (std::size_t i = 0; i < values.size() / 64; ++i) {
+    expected_best = std::max(expected_best, busy_work(values[i] * 2, 2000));
+  }
+
+  ForkJoinPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  AdaptiveGrain cheap, expensive;
+  ForkTask<double> root = analytics(values, cheap, expensive);
+  double elapsed = seconds([&] { pool.run(root); });
+  double expected = expected_sum + expected_best;
+  std::cout << "analytics: " << root.result() << " in " << elapsed << " s"
+            << (root.result() == expected ? "" : "  WRONG") << std::endl;
+  std::cout << "learned grain: cheap items " << cheap.size()
+            << ", expensive items " << expensive.size() << std::endl;
+
+  // A throwing fn: every piece has finished by the time the exception
+  // reaches the caller
+  ForkTask<> failing = parallel_for(values, 4096, [](double &v) {
+    if (v == 1998) {
+      throw std::runtime_error("bad item");
+    }
+  });
+  try {
+    pool.run(failing);
+    std::cout << "throwing fn: no exception  WRONG" << std::endl;
+  } catch (const std::runtime_error &error) {
+    std::cout << "throwing fn: rethrew \"" << error.what() << "\"" << std::endl;
+  }
+}
+
+int main() {
+  std::cout << "=== Parallel fibonacci (fork/join) ===" << std::endl;
+  fib_benchmark();
+
+  std::cout << "\n=== Product-tree factorial (BigInt) ===" << std::endl;
+  factorial_benchmark();
+
+  std::cout << "\n=== parallel_for / parallel_reduce ===" << std::endl;
+  parallel_for_demo();
+  return 0;
+}
@@ -0,0 +1,2967 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std::chrono_literals;
+
+// ==============================================================================
+// Async generator pipelines with stage fusion
+// ==============================================================================
+// simple-task.cc shows co_yield through Promise<T, Awaiter>::yield_value: the
+// caller resumes the coroutine by hand and reads the value it left in the
+// promise. This file grows that into async streams that are consumed with
+// co_await and composed with operators:
+//
+//   AsyncGenerator<std::vector<int>> batches =
+//       numbers() | map(square) | filter(is_even) | take(1000) | chunk(64);
+//
+//   while (auto batch = co_await batches.next()) { ... }
+//
+// An AsyncGenerator's body may itself co_await (timers, I/O), so a slow
+// producer suspends its consumer instead of blocking the thread.
+//
+// Stage fusion: If every operator were its own generator, each element would
+// pass through one resume/suspend pair per stage: five stages, five frame
+// switches per element. But map, filter, take and chunk never need to
+// suspend; they only transform, drop, stop or group elements. So they are
+// not coroutines here. Each one is a small "step" object, and adjacent
+// steps are composed at compile time into a single Fused<...> step. All of
+// them run inside ONE generator frame, which pulls from the source and
+// yields only what comes out of the last step:
+//
+//   numbers() | map | filter | take | chunk
+//   \-------/   \----------------------------/
+//   one frame     one frame (run_fused), steps inlined
+//
+// flat_map() produces a whole stream per element and has to await it, so it
+// is a real coroutine stage and ends the fused run before it.
+
+// ==============================================================================
+// Loop: Single-threaded ready queue with timers (like simple-time-loop.cc)
+// ==============================================================================
+// Coroutines run only on the thread calling run(). Work finishing on another
+// thread (see ThreadPool) hands its coroutine back with post():
+// - The Loop thread calls expect_post() before the coroutine suspends, so
+//   run() keeps waiting while a post is still due even if nothing else is
+//   queued
+// - post() is the only thread-safe member; it wakes run() if it is idle
+struct Loop {
+  struct TimerEntry {
+    std::chrono::steady_clock::time_point expire_time;
+    std::coroutine_handle<> handle;
+
+    bool operator>(const TimerEntry &other) const {
+      return expire_time > other.expire_time;
+    }
+  };
+
+  void add_task(std::coroutine_handle<> handle) { ready_tasks.push(handle); }
+
+  void add_timer(std::chrono::steady_clock::time_point time,
+                 std::coroutine_handle<> handle) {
+    timers.push(TimerEntry{time, handle});
+  }
+
+  void expect_post() {
+    std::lock_guard lock(post_mutex);
+    ++expected_posts;
+  }
+
+  void post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard lock(post_mutex);
+      posted_tasks.push_back(handle);
+      --expected_posts;
+    }
+    posted.notify_one();
+  }
+
+  // run(): Resume ready tasks and fire timers until there is nothing left
+  // - Sleeps until the next timer or post when nothing is ready
+  void run() {
+    while (true) {
+      {
+        std::lock_guard lock(post_mutex);
+        for (std::coroutine_handle<> handle : posted_tasks) {
+          ready_tasks.push(handle);
+        }
+        posted_tasks.clear();
+      }
+      while (!timers.empty() &&
+             timers.top().expire_time <= std::chrono::steady_clock::now()) {
+        ready_tasks.push(timers.top().handle);
+        timers.pop();
+      }
+
+      if (ready_tasks.empty()) {
+        std::unique_lock lock(post_mutex);
+        auto has_post = [this] { return !posted_tasks.empty(); };
+        if (timers.empty()) {
+          if (expected_posts == 0 && !has_post()) {
+            return;
+          }
+          posted.wait(lock, has_post);
+        } else {
+          posted.wait_until(lock, timers.top().expire_time, has_post);
+        }
+        continue;
+      }
+
+      std::coroutine_handle<> handle = ready_tasks.front();
+      ready_tasks.pop();
+      handle.resume();
+    }
+  }
+
+  std::queue<std::coroutine_handle<>> ready_tasks;
+  std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<>> timers;
+
+private:
+  std::mutex post_mutex;
+  std::condition_variable posted;
+  std::vector<std::coroutine_handle<>> posted_tasks;
+  std::size_t expected_posts{0};
+};
+
+Loop &get_global_loop() {
+  static Loop global_loop;
+  return global_loop;
+}
+
+// ==============================================================================
+// ThreadPool: Worker threads for CPU-heavy stage functions
+// ==============================================================================
+struct ThreadPool {
+  explicit ThreadPool(std::size_t threads) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  // ~ThreadPool(): Finishes the queued jobs, then joins the workers
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+  }
+
+  std::size_t size() const { return workers.size(); }
+
+private:
+  void work() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::deque<std::function<void()>> jobs;
+  bool stopping{false};
+  std::vector<std::thread> workers;
+};
+
+ThreadPool &get_worker_pool() {
+  static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+struct SleepAwaiter {
+  std::chrono::steady_clock::time_point expire_time;
+
+  bool await_ready() const noexcept {
+    return std::chrono::steady_clock::now() >= expire_time;
+  }
+
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    get_global_loop().add_timer(expire_time, coroutine);
+  }
+
+  void await_resume() noexcept {}
+};
+
+SleepAwaiter sleep_for(std::chrono::steady_clock::duration duration) {
+  return SleepAwaiter{std::chrono::steady_clock::now() + duration};
+}
+
+// ==============================================================================
+// TransferAwaiter: Suspend and symmetric-transfer to 'next'
+// ==============================================================================
+// Task's final_suspend: back to the awaiting coroutine.
+struct TransferAwaiter {
+  bool await_ready() noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> /*from*/) noexcept {
+    return next;
+  }
+
+  void await_resume() noexcept {}
+
+  std::coroutine_handle<> next;
+};
+
+// ==============================================================================
+// Task: Lazy coroutine returning T, resumed by whoever co_awaits it
+// ==============================================================================
+template <typename T> struct TaskResult {
+  void return_value(T val) { value = std::move(val); }
+
+  T result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+
+  std::optional<T> value{std::nullopt};
+  std::exception_ptr exception{nullptr};
+};
+
+template <> struct TaskResult<void> {
+  void return_void() {}
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  std::exception_ptr exception{nullptr};
+};
+
+template <typename T> struct TaskPromise : TaskResult<T> {
+  auto initial_suspend() noexcept { return std::suspend_always{}; }
+
+  auto final_suspend() noexcept { return TransferAwaiter{continuation}; }
+
+  void unhandled_exception() { this->exception = std::current_exception(); }
+
+  std::coroutine_handle<TaskPromise> get_return_object() {
+    return std::coroutine_handle<TaskPromise>::from_promise(*this);
+  }
+
+  // continuation: The coroutine awaiting this one (noop for a root task)
+  std::coroutine_handle<> continuation{std::noop_coroutine()};
+};
+
+template <typename T = void> struct Task {
+  using promise_type = TaskPromise<T>;
+
+  Task(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  Task(Task &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~Task() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+      coroutine.promise().continuation = caller;
+      return coroutine;
+    }
+
+    T await_resume() { return coroutine.promise().result(); }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  Awaiter operator co_await() { return Awaiter{coroutine}; }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// run_on_loop(): Start a root task on the global Loop and run until idle
+template <typename T> T run_on_loop(Task<T> task) {
+  get_global_loop().add_task(task.coroutine);
+  get_global_loop().run();
+  return task.coroutine.promise().result();
+}
+
+// ==============================================================================
+// AsyncGenerator: A stream of T consumed with co_await next()
+// ==============================================================================
+// co_yield of an rvalue stores a pointer to it instead of copying it into
+// the promise: the co_yield operand lives until the generator is resumed
+// again, and next() moves it out before that. An lvalue is copied into the
+// promise first (as std::generator does), so the generator's own variable
+// is never moved from behind its back.
+//
+// Handoff: next() resumes the generator with a plain resume() call from
+// inside await_suspend, and a co_yield reached during that call just returns
+// from it (handoff Waiting -> Delivered); await_suspend then returns false
+// and the consumer carries on without ever suspending. Only when the
+// generator parks on something else first (a timer, I/O) does resume()
+// return with the handoff still Waiting; the consumer then suspends, and the
+// co_yield that eventually follows, resumed from the Loop, transfers to it.
+// A symmetric transfer per element would also work, but GCC only makes it a
+// tail call when optimizing, so unoptimized and ASan builds would grow the
+// stack with every element.
+//
+// 'resumes' counts this thread's generator resumptions, i.e. frame switches,
+// for the fusion benchmark (per thread, since read_ahead resumes its source
+// on a worker).
+template <typename T> struct GeneratorPromise {
+  enum class Handoff { Idle, Waiting, Delivered };
+
+  // YieldAwaiter: Hand the element (or the end of the stream) to the consumer
+  struct YieldAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<GeneratorPromise> generator) noexcept {
+      GeneratorPromise &promise = generator.promise();
+      if (promise.handoff == Handoff::Waiting) {
+        promise.handoff = Handoff::Delivered;
+        return std::noop_coroutine();  // back into NextAwaiter's resume()
+      }
+      return promise.consumer;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  auto initial_suspend() noexcept { return std::suspend_always{}; }
+
+  auto final_suspend() noexcept { return YieldAwaiter{}; }
+
+  void unhandled_exception() { exception = std::current_exception(); }
+
+  void return_void() {}
+
+  // yield_value(): T rvalues by address, lvalues copied, anything else
+  // converted
+  YieldAwaiter yield_value(T &&value) noexcept {
+    current = std::addressof(value);
+    return YieldAwaiter{};
+  }
+
+  YieldAwaiter yield_value(T &value) {
+    converted.emplace(value);
+    current = std::addressof(*converted);
+    return YieldAwaiter{};
+  }
+
+  template <typename U>
+    requires std::is_convertible_v<U &&, T>
+  YieldAwaiter yield_value(U &&value) {
+    converted.emplace(std::forward<U>(value));
+    current = std::addressof(*converted);
+    return YieldAwaiter{};
+  }
+
+  std::coroutine_handle<GeneratorPromise> get_return_object() {
+    return std::coroutine_handle<GeneratorPromise>::from_promise(*this);
+  }
+
+  T *current{nullptr};
+  std::optional<T> converted{std::nullopt};
+  std::coroutine_handle<> consumer{std::noop_coroutine()};
+  Handoff handoff{Handoff::Idle};
+  std::exception_ptr exception{nullptr};
+
+  static inline thread_local std::size_t resumes = 0;
+};
+
+template <typename T> struct AsyncGenerator {
+  using promise_type = GeneratorPromise<T>;
+  using value_type = T;
+
+  AsyncGenerator(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  AsyncGenerator(const AsyncGenerator &) = delete;
+  AsyncGenerator &operator=(const AsyncGenerator &) = delete;
+
+  AsyncGenerator(AsyncGenerator &&other) noexcept
+      : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  AsyncGenerator &operator=(AsyncGenerator &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~AsyncGenerator() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  // NextAwaiter: co_await next() - the next element, or nullopt at the end
+  // - An exception thrown by the generator body is rethrown once, after
+  //   which the stream counts as finished
+  struct NextAwaiter {
+    bool await_ready() noexcept { return !coroutine || coroutine.done(); }
+
+    // await_suspend(): false - an element (or the end) is already here
+    bool await_suspend(std::coroutine_handle<> consumer) {
+      using Handoff = typename promise_type::Handoff;
+      ++promise_type::resumes;
+      promise_type &promise = coroutine.promise();
+      promise.consumer = consumer;
+      promise.current = nullptr;
+      promise.handoff = Handoff::Waiting;
+      coroutine.resume();
+      bool delivered = promise.handoff == Handoff::Delivered;
+      promise.handoff = Handoff::Idle;
+      return !delivered;
+    }
+
+    std::optional<T> await_resume() {
+      if (!coroutine) {
+        return std::nullopt;
+      }
+      promise_type &promise = coroutine.promise();
+      if (promise.exception) {
+        std::rethrow_exception(std::exchange(promise.exception, nullptr));
+      }
+      if (coroutine.done() || !promise.current) {
+        return std::nullopt;
+      }
+      return std::optional<T>(std::move(*promise.current));
+    }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  NextAwaiter next() { return NextAwaiter{coroutine}; }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// ==============================================================================
+// Synchronous steps: the fusable operators
+// ==============================================================================
+// A step is bound to its input type when it is piped onto a stream, and has:
+//   input_type / output_type
+//   step(In &&)  -> std::optional<Out>  (nullopt: dropped, or held back)
+//   done()       -> bool                (wants no more input, e.g. take)
+//   finish()     -> std::optional<Out>  (end of input; called until nullopt,
+//                                        e.g. chunk flushes its last group)
+// Each step emits at most one output per input, which is what lets a fused
+// chain be a plain nested call instead of a coroutine per stage.
+template <typename In, typename F> struct MapStep {
+  using input_type = In;
+  using output_type = std::remove_cvref_t<std::invoke_result_t<F &, In &&>>;
+
+  std::optional<output_type> step(In &&value) { return f(std::move(value)); }
+  bool done() const { return false; }
+  std::optional<output_type> finish() { return std::nullopt; }
+
+  F f;
+};
+
+template <typename In, typename P> struct FilterStep {
+  using input_type = In;
+  using output_type = In;
+
+  std::optional<In> step(In &&value) {
+    if (predicate(std::as_const(value))) {
+      return std::optional<In>(std::move(value));
+    }
+    return std::nullopt;
+  }
+  bool done() const { return false; }
+  std::optional<In> finish() { return std::nullopt; }
+
+  P predicate;
+};
+
+template <typename In> struct TakeStep {
+  using input_type = In;
+  using output_type = In;
+
+  std::optional<In> step(In &&value) {
+    ++taken;
+    return std::optional<In>(std::move(value));
+  }
+  bool done() const { return taken >= count; }
+  std::optional<In> finish() { return std::nullopt; }
+
+  std::size_t count;
+  std::size_t taken{0};
+};
+
+template <typename In> struct ChunkStep {
+  using input_type = In;
+  using output_type = std::vector<In>;
+
+  std::optional<output_type> step(In &&value) {
+    if (group.empty()) {
+      group.reserve(size);
+    }
+    group.push_back(std::move(value));
+    if (group.size() < size) {
+      return std::nullopt;
+    }
+    return std::exchange(group, {});
+  }
+  bool done() const { return false; }
+  std::optional<output_type> finish() {
+    if (group.empty()) {
+      return std::nullopt;
+    }
+    return std::exchange(group, {});
+  }
+
+  std::size_t size;
+  output_type group;
+};
+
+// Fused: Two adjacent steps as one; 'B' consumes what 'A' produces
+template <typename A, typename B> struct Fused {
+  static_assert(std::is_same_v<typename A::output_type, typename B::input_type>);
+  using input_type = typename A::input_type;
+  using output_type = typename B::output_type;
+
+  std::optional<output_type> step(input_type &&value) {
+    if (auto middle = a.step(std::move(value))) {
+      return b.step(std::move(*middle));
+    }
+    return std::nullopt;
+  }
+
+  bool done() const { return a.done() || b.done(); }
+
+  // finish(): Drain what A holds back through B, then let B flush
+  std::optional<output_type> finish() {
+    while (!b.done()) {
+      auto middle = a.finish();
+      if (!middle) {
+        break;
+      }
+      if (auto out = b.step(std::move(*middle))) {
+        return out;
+      }
+    }
+    return b.finish();
+  }
+
+  A a;
+  B b;
+};
+
+// Operator objects: what map(f), filter(p), ... return before the input
+// type is known; bind<In>() turns them into the step for that input
+template <typename F> struct MapOperator {
+  template <typename In> MapStep<In, F> bind() && { return {std::move(f)}; }
+  F f;
+};
+
+template <typename P> struct FilterOperator {
+  template <typename In> FilterStep<In, P> bind() && {
+    return {std::move(predicate)};
+  }
+  P predicate;
+};
+
+struct TakeOperator {
+  template <typename In> TakeStep<In> bind() && { return {count}; }
+  std::size_t count;
+};
+
+struct ChunkOperator {
+  template <typename In> ChunkStep<In> bind() && { return {size, {}}; }
+  std::size_t size;
+};
+
+template <typename F> MapOperator<F> map(F f) { return {std::move(f)}; }
+template <typename P> FilterOperator<P> filter(P predicate) {
+  return {std::move(predicate)};
+}
+TakeOperator take(std::size_t count) { return {count}; }
+ChunkOperator chunk(std::size_t size) { return {std::max<std::size_t>(size, 1)}; }
+
+template <typename Op, typename In>
+concept SyncOperator = requires(Op op) { std::move(op).template bind<In>(); };
+
+// ==============================================================================
+// FusedStream: A source plus the steps piped onto it so far
+// ==============================================================================
+// Piping another synchronous operator only extends the Fused<...> type; the
+// single run_fused() frame is created when the stream is converted to an
+// AsyncGenerator (assigned, or piped into an async stage such as flat_map).
+template <typename Steps>
+AsyncGenerator<typename Steps::output_type>
+run_fused(AsyncGenerator<typename Steps::input_type> source, Steps steps) {
+  while (!steps.done()) {
+    auto item = co_await source.next();
+    if (!item) {
+      break;
+    }
+    if (auto out = steps.step(std::move(*item))) {
+      co_yield std::move(*out);
+    }
+  }
+  while (auto out = steps.finish()) {
+    co_yield std::move(*out);
+  }
+}
+
+template <typename Steps> struct FusedStream {
+  using value_type = typename Steps::output_type;
+
+  operator AsyncGenerator<value_type>() && {
+    return run_fused(std::move(source), std::move(steps));
+  }
+
+  AsyncGenerator<typename Steps::input_type> source;
+  Steps steps;
+};
+
+template <typename T, SyncOperator<T> Op>
+auto operator|(AsyncGenerator<T> source, Op op) {
+  using Step = decltype(std::move(op).template bind<T>());
+  return FusedStream<Step>{std::move(source), std::move(op).template bind<T>()};
+}
+
+template <typename Steps, SyncOperator<typename Steps::output_type> Op>
+auto operator|(FusedStream<Steps> stream, Op op) {
+  using Step =
+      decltype(std::move(op).template bind<typename Steps::output_type>());
+  using Chain = Fused<Steps, Step>;
+  return FusedStream<Chain>{
+      std::move(stream.source),
+      Chain{std::move(stream.steps),
+            std::move(op).template bind<typename Steps::output_type>()}};
+}
+
+// to_generator(): Any stream as an AsyncGenerator (materializes fused steps)
+template <typename T> AsyncGenerator<T> to_generator(AsyncGenerator<T> stream) {
+  return stream;
+}
+
+template <typename Steps>
+AsyncGenerator<typename Steps::output_type> to_generator(FusedStream<Steps> stream) {
+  return stream;  // implicitly moved, then converted
+}
+
+// ==============================================================================
+// flat_map: An async stage, each element expands into a whole stream
+// ==============================================================================
+template <typename F> struct FlatMapOperator {
+  F f;
+};
+
+template <typename F> FlatMapOperator<F> flat_map(F f) { return {std::move(f)}; }
+
+template <typename T, typename F>
+using FlatMapStream =
+    decltype(to_generator(std::declval<std::invoke_result_t<F &, T &&>>()));
+
+template <typename T, typename F>
+FlatMapStream<T, F> run_flat_map(AsyncGenerator<T> source, F f) {
+  while (auto item = co_await source.next()) {
+    auto inner = to_generator(f(std::move(*item)));
+    while (auto value = co_await inner.next()) {
+      co_yield std::move(*value);
+    }
+  }
+}
+
+template <typename Stream, typename F>
+  requires requires(Stream stream) { to_generator(std::move(stream)); }
+auto operator|(Stream stream, FlatMapOperator<F> op) {
+  auto source = to_generator(std::move(stream));
+  using T = typename decltype(source)::value_type;
+  return run_flat_map<T>(std::move(source), std::move(op.f));
+}
+
+// ==============================================================================
+// parallel_map: Run a CPU-heavy function on the worker pool, N items at once
+// ==============================================================================
+// stream | parallel_map(parse, 8) keeps up to 8 items in flight on the
+// ThreadPool while the stage itself stays a generator on the Loop: it pulls
+// from its source whenever a slot is free and yields results as they become
+// ready, suspending only when nothing can be done until a worker finishes.
+//
+// Slots: Each in-flight item owns one of N slots, which holds its input and
+// then its result until the stage emits it. Free slots are kept in a list.
+// - Ordering::Preserve: the slots in submission order form the reorder ring;
+//   the stage waits for the oldest one and emits in input order, so a slow
+//   item holds back the faster ones after it (they stay parked in the ring)
+// - Ordering::Unordered: slots are emitted in completion order; a slow item
+//   only occupies its own slot
+//
+// The function runs on several worker threads at once, so it must not touch
+// unsynchronized shared state. An exception it throws is rethrown from
+// next() at that item's position in the output, and ends the stream.
+//
+// The stage state is shared with the worker jobs, so dropping the stream
+// while items are still in flight is safe.
+enum class Ordering { Preserve, Unordered };
+
+template <typename T, typename F> struct ParallelMapState {
+  using Result = std::remove_cvref_t<std::invoke_result_t<F &, T &&>>;
+
+  struct Slot {
+    std::optional<T> input{std::nullopt};
+    std::optional<Result> output{std::nullopt};
+    std::exception_ptr error{nullptr};
+    bool ready{false};
+  };
+
+  ParallelMapState(F f, std::size_t width, Ordering ordering)
+      : f(std::move(f)), slots(width), ordering(ordering) {
+    for (std::size_t slot = width; slot-- > 0;) {
+      free_slots.push_back(slot);
+    }
+  }
+
+  // can_emit(): Under 'mutex'
+  bool can_emit() const {
+    if (ordering == Ordering::Preserve) {
+      return !in_order.empty() && slots[in_order.front()].ready;
+    }
+    return !completed.empty();
+  }
+
+  // run_item(): On a worker thread
+  void run_item(std::size_t index) {
+    Slot &slot = slots[index];
+    std::optional<Result> output;
+    std::exception_ptr error;
+    try {
+      output.emplace(f(std::move(*slot.input)));
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    std::coroutine_handle<> to_wake;
+    {
+      std::lock_guard lock(mutex);
+      slot.input.reset();
+      slot.output = std::move(output);
+      slot.error = error;
+      slot.ready = true;
+      if (ordering == Ordering::Unordered) {
+        completed.push_back(index);
+      }
+      if (waiter && can_emit()) {
+        to_wake = std::exchange(waiter, nullptr);
+      }
+    }
+    if (to_wake) {
+      get_global_loop().post(to_wake);
+    }
+  }
+
+  // ReadyAwaiter: Suspend the stage until can_emit()
+  struct ReadyAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> stage) {
+      std::lock_guard lock(state->mutex);
+      if (state->can_emit()) {
+        return false;
+      }
+      state->waiter = stage;
+      get_global_loop().expect_post();
+      return true;
+    }
+
+    void await_resume() noexcept {}
+
+    ParallelMapState *state;
+  };
+
+  F f;
+  std::vector<Slot> slots;
+  Ordering ordering;
+  std::vector<std::size_t> free_slots;  // only touched by the stage
+
+  std::mutex mutex;
+  std::deque<std::size_t> in_order;   // Preserve: in flight, oldest first
+  std::deque<std::size_t> completed;  // Unordered: in completion order
+  std::coroutine_handle<> waiter{nullptr};
+};
+
+template <typename T, typename F>
+AsyncGenerator<typename ParallelMapState<T, F>::Result>
+run_parallel_map(AsyncGenerator<T> source,
+                 std::shared_ptr<ParallelMapState<T, F>> state) {
+  using State = ParallelMapState<T, F>;
+  const std::size_t width = state->slots.size();
+  bool exhausted = false;
+
+  while (true) {
+    // 1. Something finished (in the required order): emit it
+    std::optional<typename State::Result> output;
+    std::exception_ptr error;
+    bool emit = false;
+    if (state->free_slots.size() < width) {
+      std::lock_guard lock(state->mutex);
+      if (state->can_emit()) {
+        std::deque<std::size_t> &queue = state->ordering == Ordering::Preserve
+                                             ? state->in_order
+                                             : state->completed;
+        std::size_t index = queue.front();
+        queue.pop_front();
+        typename State::Slot &slot = state->slots[index];
+        output = std::move(slot.output);
+        error = slot.error;
+        slot.output.reset();
+        slot.error = nullptr;
+        slot.ready = false;
+        state->free_slots.push_back(index);
+        emit = true;
+      }
+    }
+    if (emit) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      co_yield std::move(*output);
+      continue;
+    }
+
+    // 2. A slot is free: start the next item
+    if (!exhausted && !state->free_slots.empty()) {
+      auto item = co_await source.next();
+      if (!item) {
+        exhausted = true;
+        continue;
+      }
+      std::size_t index = state->free_slots.back();
+      state->free_slots.pop_back();
+      state->slots[index].input = std::move(*item);
+      if (state->ordering == Ordering::Preserve) {
+        std::lock_guard lock(state->mutex);
+        state->in_order.push_back(index);
+      }
+      get_worker_pool().submit([state, index] { state->run_item(index); });
+      continue;
+    }
+
+    // 3. Nothing in flight and nothing left: done
+    if (state->free_slots.size() == width) {
+      break;
+    }
+
+    // 4. All slots busy (or source finished): wait for a worker
+    co_await typename State::ReadyAwaiter{state.get()};
+  }
+}
+
+template <typename F> struct ParallelMapOperator {
+  F f;
+  std::size_t width;
+  Ordering ordering;
+};
+
+// parallel_map(f, width, ordering): At most 'width' items in flight
+template <typename F>
+ParallelMapOperator<F> parallel_map(F f, std::size_t width,
+                                    Ordering ordering = Ordering::Preserve) {
+  return {std::move(f), std::max<std::size_t>(width, 1), ordering};
+}
+
+template <typename Stream, typename F>
+  requires requires(Stream stream) { to_generator(std::move(stream)); }
+auto operator|(Stream stream, ParallelMapOperator<F> op) {
+  auto source = to_generator(std::move(stream));
+  using T = typename decltype(source)::value_type;
+  return run_parallel_map<T, F>(
+      std::move(source), std::make_shared<ParallelMapState<T, F>>(
+                             std::move(op.f), op.width, op.ordering));
+}
+
+// ==============================================================================
+// Batched generators: co_yield std::span<T> over a caller-provided buffer
+// ==============================================================================
+// Yielding one element per co_yield costs a generator resume per element.
+// A batched generator fills a buffer that its consumer owns and yields the
+// filled part as one std::span<T>:
+//
+//   std::vector<long> buffer(4096);
+//   BatchGenerator<long> batches = number_batches(count, buffer);
+//   while (auto batch = co_await batches.next()) {
+//     for (long value : *batch) { ... }   // plain loop, vectorizes
+//   }
+//
+// - One resume per batch instead of per element
+// - The consumer's inner loop runs over contiguous memory with a trip count
+//   the compiler can see, so it can be vectorized
+// - No allocation per batch: the same buffer is refilled, and the batch the
+//   consumer reads was just written, so it is still in cache (size the
+//   buffer to fit in L1/L2)
+//
+// The span is only valid until the consumer calls next() again, when the
+// generator overwrites the buffer. The buffer must outlive the generator,
+// and must not be empty: the batch producers throw std::invalid_argument
+// when they are called with one, before any frame is created.
+template <typename T> using BatchGenerator = AsyncGenerator<std::span<T>>;
+
+template <typename T>
+BatchGenerator<T> run_batch_into(AsyncGenerator<T> source, std::span<T> buffer) {
+  std::size_t filled = 0;
+  while (auto item = co_await source.next()) {
+    buffer[filled++] = std::move(*item);
+    if (filled == buffer.size()) {
+      co_yield buffer.first(std::exchange(filled, 0));
+    }
+  }
+  if (filled != 0) {
+    co_yield buffer.first(filled);
+  }
+}
+
+// batch_into(): Regroup a one-element-per-yield stream into batches
+// - The source still resumes once per element; this is for feeding an
+//   existing element stream into a batch consumer, not a speed-up by itself
+template <typename T>
+BatchGenerator<T> batch_into(AsyncGenerator<T> source, std::span<T> buffer) {
+  if (buffer.empty()) {
+    throw std::invalid_argument("batch_into: empty buffer");
+  }
+  return run_batch_into(std::move(source), buffer);
+}
+
+// ==============================================================================
+// Stream reducers: sum, min/max, count_if and histogram over span batches
+// ==============================================================================
+// co_await reduce(batches, reducers...) feeds every batch of a
+// BatchGenerator to each reducer while the batch is still in cache, and
+// returns the reducers once the stream ends:
+//
+//   auto [sum, range, slow, latency] = co_await reduce(
+//       std::move(batches), Sum<std::int32_t>{}, MinMax<std::int32_t>{},
+//       CountIf{greater_than<std::int32_t>(5000)},
+//       Histogram<std::int32_t>(0, 10000, 20));
+//
+// The reducers call batch kernels, not per-element code. For std::int32_t
+// and double there are AVX2 versions, picked at runtime with
+// __builtin_cpu_supports so the binary still runs on CPUs without AVX2; the
+// scalar versions are the fallback for those CPUs and for other types.
+// Kernel differences worth knowing:
+// - Sum of int32 accumulates in 64 bits (no overflow below ~2^32 values)
+// - Sum of double in AVX2 adds in a different order than the scalar loop,
+//   so the last bits may differ
+// - Min/max of double with NaN inputs is unspecified
+// - count_if only vectorizes the comparison predicates less_than(),
+//   greater_than() and equal_to(); any other predicate runs scalar
+enum class Comparison { Less, Greater, Equal };
+
+template <typename T> struct Compare {
+  bool operator()(T x) const {
+    switch (op) {
+    case Comparison::Less:
+      return x < value;
+    case Comparison::Greater:
+      return x > value;
+    case Comparison::Equal:
+      return x == value;
+    }
+    return false;
+  }
+
+  Comparison op;
+  T value;
+};
+
+template <typename T> Compare<T> less_than(T value) {
+  return {Comparison::Less, value};
+}
+template <typename T> Compare<T> greater_than(T value) {
+  return {Comparison::Greater, value};
+}
+template <typename T> Compare<T> equal_to(T value) {
+  return {Comparison::Equal, value};
+}
+
+template <typename T>
+using SumType = std::conditional_t<std::is_integral_v<T>, std::int64_t, double>;
+
+template <typename T> struct Range {
+  T min;
+  T max;
+};
+
+// HistogramSpec: 'buckets' equal-width buckets over [lo, hi)
+// - Bucket index 0 counts values below lo (and NaN), buckets + 1 values at
+//   or above hi, so counts has buckets + 2 entries
+struct HistogramSpec {
+  double lo;
+  double scale;  // buckets / (hi - lo)
+  std::size_t buckets;
+};
+
+// ==============================================================================
+// Scalar kernels (any arithmetic T)
+// ==============================================================================
+template <typename T> SumType<T> sum_scalar(std::span<const T> values) {
+  SumType<T> total = 0;
+  for (T value : values) {
+    total += value;
+  }
+  return total;
+}
+
+template <typename T> Range<T> range_scalar(std::span<const T> values, Range<T> range) {
+  for (T value : values) {
+    range.min = std::min(range.min, value);
+    range.max = std::max(range.max, value);
+  }
+  return range;
+}
+
+template <typename T>
+std::size_t count_scalar(std::span<const T> values, Compare<T> compare) {
+  std::size_t count = 0;
+  for (T value : values) {
+    count += compare(value);
+  }
+  return count;
+}
+
+// bucket_of(): Shared by both histogram kernels so they agree exactly
+std::size_t bucket_of(double value, const HistogramSpec &spec) {
+  double position = std::floor((value - spec.lo) * spec.scale);
+  if (!(position >= -1)) {  // also catches NaN
+    position = -1;
+  }
+  position = std::min(position, double(spec.buckets));
+  return std::size_t(position + 1);
+}
+
+template <typename T>
+void histogram_scalar(std::span<const T> values, const HistogramSpec &spec,
+                      std::uint64_t *counts) {
+  for (T value : values) {
+    ++counts[bucket_of(double(value), spec)];
+  }
+}
+
+#if defined(__x86_64__)
+// ==============================================================================
+// AVX2 kernels for std::int32_t and double
+// ==============================================================================
+// Each processes full vectors and hands the tail to the scalar kernel.
+__attribute__((target("avx2"))) std::int64_t
+sum_avx2(std::span<const std::int32_t> values) {
+  __m256i low = _mm256_setzero_si256();
+  __m256i high = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 8 <= values.size(); i += 8) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values.data() + i));
+    low = _mm256_add_epi64(low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    high = _mm256_add_epi64(high,
+                            _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  alignas(32) std::int64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(low, high));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         sum_scalar(values.subspan(i));
+}
+
+__attribute__((target("avx2"))) double sum_avx2(std::span<const double> values) {
+  // Four independent accumulators hide the latency of vaddpd
+  __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(),
+                    _mm256_setzero_pd(), _mm256_setzero_pd()};
+  std::size_t i = 0;
+  for (; i + 16 <= values.size(); i += 16) {
+    for (int k = 0; k < 4; ++k) {
+      acc[k] = _mm256_add_pd(acc[k], _mm256_loadu_pd(values.data() + i + 4 * k));
+    }
+  }
+  __m256d total = _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]),
+                                _mm256_add_pd(acc[2], acc[3]));
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         sum_scalar(values.subspan(i));
+}
+
+__attribute__((target("avx2"))) Range<std::int32_t>
+range_avx2(std::span<const std::int32_t> values, Range<std::int32_t> range) {
+  __m256i low = _mm256_set1_epi32(range.min);
+  __m256i high = _mm256_set1_epi32(range.max);
+  std::size_t i = 0;
+  for (; i + 8 <= values.size(); i += 8) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values.data() + i));
+    low = _mm256_min_epi32(low, v);
+    high = _mm256_max_epi32(high, v);
+  }
+  alignas(32) std::int32_t lows[8], highs[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lows), low);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(highs), high);
+  for (int k = 0; k < 8; ++k) {
+    range.min = std::min(range.min, lows[k]);
+    range.max = std::max(range.max, highs[k]);
+  }
+  return range_scalar(values.subspan(i), range);
+}
+
+__attribute__((target("avx2"))) Range<double>
+range_avx2(std::span<const double> values, Range<double> range) {
+  __m256d low = _mm256_set1_pd(range.min);
+  __m256d high = _mm256_set1_pd(range.max);
+  std::size_t i = 0;
+  for (; i + 4 <= values.size(); i += 4) {
+    __m256d v = _mm256_loadu_pd(values.data() + i);
+    low = _mm256_min_pd(low, v);
+    high = _mm256_max_pd(high, v);
+  }
+  alignas(32) double lows[4], highs[4];
+  _mm256_store_pd(lows, low);
+  _mm256_store_pd(highs, high);
+  for (int k = 0; k < 4; ++k) {
+    range.min = std::min(range.min, lows[k]);
+    range.max = std::max(range.max, highs[k]);
+  }
+  return range_scalar(values.subspan(i), range);
+}
+
+// count_avx2(): A true comparison is all ones (-1), so subtracting the mask
+// adds 1 per matching lane
+__attribute__((target("avx2"))) std::size_t
+count_avx2(std::span<const std::int32_t> values, Compare<std::int32_t> compare) {
+  const __m256i threshold = _mm256_set1_epi32(compare.value);
+  __m256i counts = _mm256_setzero_si256();
+  std::size_t i = 0;
+  std::size_t total = 0;
+  while (i + 8 <= values.size()) {
+    // Per-lane counters are 32 bits; fold them before they could overflow
+    std::size_t block_end = std::min(values.size() & ~std::size_t(7),
+                                     i + (std::size_t(1) << 31));
+    for (; i < block_end; i += 8) {
+      __m256i v = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(values.data() + i));
+      __m256i match;
+      switch (compare.op) {
+      case Comparison::Less:
+        match = _mm256_cmpgt_epi32(threshold, v);
+        break;
+      case Comparison::Greater:
+        match = _mm256_cmpgt_epi32(v, threshold);
+        break;
+      default:
+        match = _mm256_cmpeq_epi32(v, threshold);
+        break;
+      }
+      counts = _mm256_sub_epi32(counts, match);
+    }
+    alignas(32) std::uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), counts);
+    for (std::uint32_t lane : lanes) {
+      total += lane;
+    }
+    counts = _mm256_setzero_si256();
+  }
+  return total + count_scalar(values.subspan(i), compare);
+}
+
+__attribute__((target("avx2,popcnt"))) std::size_t
+count_avx2(std::span<const double> values, Compare<double> compare) {
+  const __m256d threshold = _mm256_set1_pd(compare.value);
+  std::size_t total = 0;
+  std::size_t i = 0;
+  for (; i + 4 <= values.size(); i += 4) {
+    __m256d v = _mm256_loadu_pd(values.data() + i);
+    __m256d match;
+    switch (compare.op) {
+    case Comparison::Less:
+      match = _mm256_cmp_pd(v, threshold, _CMP_LT_OQ);
+      break;
+    case Comparison::Greater:
+      match = _mm256_cmp_pd(v, threshold, _CMP_GT_OQ);
+      break;
+    default:
+      match = _mm256_cmp_pd(v, threshold, _CMP_EQ_OQ);
+      break;
+    }
+    total += std::size_t(_mm_popcnt_u32(unsigned(_mm256_movemask_pd(match))));
+  }
+  return total + count_scalar(values.subspan(i), compare);
+}
+
+// histogram_avx2(): Bucket indices four at a time, then scalar increments
+// - Same arithmetic as bucket_of() (subtract, multiply, floor, clamp), so
+//   both kernels put every value in the same bucket
+// - max_pd(x, -1) returns -1 when x is NaN, matching bucket_of()
+template <typename T>
+__attribute__((target("avx2"))) void
+histogram_avx2(std::span<const T> values, const HistogramSpec &spec,
+               std::uint64_t *counts) {
+  const __m256d lo = _mm256_set1_pd(spec.lo);
+  const __m256d scale = _mm256_set1_pd(spec.scale);
+  const __m256d below = _mm256_set1_pd(-1);
+  const __m256d above = _mm256_set1_pd(double(spec.buckets));
+  const __m256d one = _mm256_set1_pd(1);
+  std::size_t i = 0;
+  for (; i + 4 <= values.size(); i += 4) {
+    __m256d v;
+    if constexpr (std::is_same_v<T, std::int32_t>) {
+      v = _mm256_cvtepi32_pd(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(values.data() + i)));
+    } else {
+      v = _mm256_loadu_pd(values.data() + i);
+    }
+    __m256d position = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(v, lo), scale));
+    position = _mm256_min_pd(_mm256_max_pd(position, below), above);
+    alignas(16) std::int32_t index[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(index),
+                    _mm256_cvtpd_epi32(_mm256_add_pd(position, one)));
+    ++counts[index[0]];
+    ++counts[index[1]];
+    ++counts[index[2]];
+    ++counts[index[3]];
+  }
+  histogram_scalar(values.subspan(i), spec, counts);
+}
+#endif
+
+// use_simd_kernels(): AVX2 available, and not switched off for comparison
+bool force_scalar_kernels = false;
+
+bool use_simd_kernels() {
+#if defined(__x86_64__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2 && !force_scalar_kernels;
+#else
+  return false;
+#endif
+}
+
+template <typename T>
+constexpr bool has_simd_kernels =
+    std::is_same_v<T, std::int32_t> || std::is_same_v<T, double>;
+
+// ==============================================================================
+// Reducers
+// ==============================================================================
+// Each has add(std::span<const T>) and exposes its result as public members.
+template <typename T> struct Sum {
+  void add(std::span<const T> batch) {
+#if defined(__x86_64__)
+    if constexpr (has_simd_kernels<T>) {
+      if (use_simd_kernels()) {
+        value += sum_avx2(batch);
+        return;
+      }
+    }
+#endif
+    value += sum_scalar(batch);
+  }
+
+  SumType<T> value{0};
+};
+
+template <typename T> struct MinMax {
+  void add(std::span<const T> batch) {
+#if defined(__x86_64__)
+    if constexpr (has_simd_kernels<T>) {
+      if (use_simd_kernels()) {
+        range = range_avx2(batch, range);
+        return;
+      }
+    }
+#endif
+    range = range_scalar(batch, range);
+  }
+
+  // Empty stream: min > max
+  Range<T> range{std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest()};
+};
+
+template <typename Predicate> struct CountIf {
+  template <typename T> void add(std::span<const T> batch) {
+#if defined(__x86_64__)
+    if constexpr (std::is_same_v<Predicate, Compare<T>> && has_simd_kernels<T>) {
+      if (use_simd_kernels()) {
+        count += count_avx2(batch, predicate);
+        return;
+      }
+    }
+#endif
+    if constexpr (std::is_same_v<Predicate, Compare<T>>) {
+      count += count_scalar(batch, predicate);
+    } else {
+      count += std::size_t(std::count_if(batch.begin(), batch.end(), predicate));
+    }
+  }
+
+  Predicate predicate;
+  std::size_t count{0};
+};
+
+template <typename Predicate> CountIf(Predicate) -> CountIf<Predicate>;
+
+template <typename T> struct Histogram {
+  Histogram(T lo, T hi, std::size_t buckets)
+      : spec{double(lo), double(buckets) / (double(hi) - double(lo)), buckets},
+        counts(buckets + 2, 0) {}
+
+  void add(std::span<const T> batch) {
+#if defined(__x86_64__)
+    if constexpr (has_simd_kernels<T>) {
+      if (use_simd_kernels()) {
+        histogram_avx2(batch, spec, counts.data());
+        return;
+      }
+    }
+#endif
+    histogram_scalar(batch, spec, counts.data());
+  }
+
+  HistogramSpec spec;
+  std::vector<std::uint64_t> counts;  // [0] below lo, [buckets + 1] >= hi
+};
+
+// reduce(): One pass over the stream, every reducer sees every batch
+template <typename T, typename... Reducers>
+Task<std::tuple<Reducers...>> reduce(BatchGenerator<T> batches,
+                                     Reducers... reducers) {
+  while (auto batch = co_await batches.next()) {
+    std::span<const T> values = *batch;
+    (reducers.add(values), ...);
+  }
+  co_return std::tuple<Reducers...>(std::move(reducers)...);
+}
+
+// ==============================================================================
+// read_ahead: Run the source ahead of its consumer on a worker thread
+// ==============================================================================
+// A generator only runs when its consumer calls next(), so a slow producer
+// and a slow consumer take turns and their costs add up. stream |
+// read_ahead(depth) decouples them with a bounded ring of 'depth' elements:
+// a pump coroutine pulls from the source into the ring on the worker pool,
+// and the consumer reads from the ring on the Loop.
+//
+//   source ---(pump, worker pool)---> [ ring of depth ] ---(Loop)---> consumer
+//
+// - The pump parks when the ring is full and the consumer restarts it once
+//   the ring is down to half, so a fast consumer wakes it once per
+//   depth / 2 elements, not per element
+// - The consumer suspends only when the ring is empty
+// - While parked, the pump does not hold a worker thread
+//
+// This is for producers that block or compute: pread() on a file, a
+// decompression library. The source is resumed on worker threads, so its
+// body must not co_await anything tied to the Loop (sleep_for, Loop I/O);
+// those producers already overlap with their consumer on the Loop.
+// Elements are moved through the ring and are not shared between threads.
+// An exception from the source is rethrown from next() after the elements
+// produced before it. Dropping the stream stops the pump after at most one
+// more element.
+
+// Detached: A coroutine nobody awaits; its frame is freed when it finishes
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// ResumeOnWorker: co_await to continue on a worker pool thread
+struct ResumeOnWorker {
+  bool await_ready() noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> coroutine) {
+    get_worker_pool().submit([coroutine] { coroutine.resume(); });
+  }
+
+  void await_resume() noexcept {}
+};
+
+template <typename T> struct ReadAheadState {
+  ReadAheadState(AsyncGenerator<T> source, std::size_t depth)
+      : source(std::move(source)), ring(depth) {}
+
+  // push() / pop(): Under 'mutex'
+  void push(T value) {
+    ring[(head + count) % ring.size()].emplace(std::move(value));
+    ++count;
+  }
+
+  T pop() {
+    T value = std::move(*ring[head]);
+    ring[head].reset();
+    head = (head + 1) % ring.size();
+    --count;
+    return value;
+  }
+
+  // SpaceAwaiter: The pump waits until the ring is not full
+  // - await_resume() returns false once the consumer has gone
+  struct SpaceAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> pump) {
+      std::lock_guard lock(state->mutex);
+      if (state->cancelled || state->count < state->ring.size()) {
+        return false;
+      }
+      state->parked_pump = pump;
+      return true;
+    }
+
+    bool await_resume() {
+      std::lock_guard lock(state->mutex);
+      return !state->cancelled;
+    }
+
+    ReadAheadState *state;
+  };
+
+  // ItemAwaiter: The consumer waits until the ring has an element or the
+  // source has finished
+  struct ItemAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> consumer) {
+      std::lock_guard lock(state->mutex);
+      if (state->count != 0 || state->finished) {
+        return false;
+      }
+      state->waiter = consumer;
+      get_global_loop().expect_post();
+      return true;
+    }
+
+    void await_resume() noexcept {}
+
+    ReadAheadState *state;
+  };
+
+  // restart_pump(): Under 'mutex'; the pump resumes on a worker
+  void restart_pump() {
+    if (std::coroutine_handle<> pump = std::exchange(parked_pump, nullptr)) {
+      get_worker_pool().submit([pump] { pump.resume(); });
+    }
+  }
+
+  AsyncGenerator<T> source;  // only touched by the pump
+
+  std::mutex mutex;
+  std::vector<std::optional<T>> ring;
+  std::size_t head{0};
+  std::size_t count{0};
+  bool finished{false};   // the source ended (or threw 'error')
+  bool cancelled{false};  // the consumer dropped the stream
+  std::exception_ptr error{nullptr};
+  std::coroutine_handle<> parked_pump{nullptr};
+  std::coroutine_handle<> waiter{nullptr};  // the consumer, on the Loop
+};
+
+template <typename T> Detached pump(std::shared_ptr<ReadAheadState<T>> state) {
+  co_await ResumeOnWorker{};
+  while (co_await typename ReadAheadState<T>::SpaceAwaiter{state.get()}) {
+    std::optional<T> item;
+    std::exception_ptr error;
+    try {
+      item = co_await state->source.next();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    std::coroutine_handle<> to_wake;
+    {
+      std::lock_guard lock(state->mutex);
+      if (item) {
+        state->push(std::move(*item));
+      } else {
+        state->finished = true;
+        state->error = error;
+      }
+      if (state->waiter) {
+        to_wake = std::exchange(state->waiter, nullptr);
+      }
+    }
+    if (to_wake) {
+      get_global_loop().post(to_wake);
+    }
+    if (!item) {
+      break;
+    }
+  }
+}
+
+// ReadAheadHandle: The consumer's share of the state; stops the pump when
+// the consumer's generator frame is destroyed, even if it never started
+template <typename T> struct ReadAheadHandle {
+  explicit ReadAheadHandle(std::shared_ptr<ReadAheadState<T>> state)
+      : state(std::move(state)) {}
+
+  ReadAheadHandle(ReadAheadHandle &&) noexcept = default;
+
+  ~ReadAheadHandle() {
+    if (state) {
+      std::lock_guard lock(state->mutex);
+      state->cancelled = true;
+      state->restart_pump();
+    }
+  }
+
+  std::shared_ptr<ReadAheadState<T>> state;
+};
+
+template <typename T> AsyncGenerator<T> run_read_ahead(ReadAheadHandle<T> handle) {
+  ReadAheadState<T> &state = *handle.state;
+  const std::size_t low_water = state.ring.size() / 2;
+  while (true) {
+    co_await typename ReadAheadState<T>::ItemAwaiter{&state};
+    std::optional<T> item;
+    std::exception_ptr error;
+    {
+      std::lock_guard lock(state.mutex);
+      if (state.count != 0) {
+        item.emplace(state.pop());
+        if (state.count <= low_water) {
+          state.restart_pump();
+        }
+      } else {
+        error = std::exchange(state.error, nullptr);
+      }
+    }
+    if (!item) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+      break;
+    }
+    co_yield std::move(*item);
+  }
+}
+
+struct ReadAheadOperator {
+  std::size_t depth;
+};
+
+// read_ahead(depth): Keep up to 'depth' elements produced ahead
+ReadAheadOperator read_ahead(std::size_t depth) {
+  return {std::max<std::size_t>(depth, 1)};
+}
+
+// operator|: The pump starts right away, so the ring is filling before the
+// consumer's first next()
+template <typename Stream>
+  requires requires(Stream stream) { to_generator(std::move(stream)); }
+auto operator|(Stream stream, ReadAheadOperator op) {
+  auto source = to_generator(std::move(stream));
+  using T = typename decltype(source)::value_type;
+  auto state = std::make_shared<ReadAheadState<T>>(std::move(source), op.depth);
+  pump(state);
+  return run_read_ahead(ReadAheadHandle<T>(std::move(state)));
+}
+
+// ==============================================================================
+// Combinators over several sources: merge, zip, interleave, merge_sorted
+// ==============================================================================
+//   merge(a, b, c)          elements in the order they become ready
+//   zip(a, b)               std::tuple of one element from each; ends with
+//                           the shortest source
+//   interleave(sources)     a1 b1 c1 a2 b2 c2 ..., skipping finished sources
+//   merge_sorted(sources)   k sorted sources into one sorted stream (loser
+//                           tree, stable: ties go to the lower source index)
+//
+// Lanes: Each source is pulled by its own small coroutine (a lane), so all
+// of them can be waiting on their I/O or timers at the same time. A lane
+// pulls one element, reports it to the combinator's Readiness, and parks
+// until the combinator takes the element and calls request(). The combinator
+// suspends on Readiness and is resumed by the lane that delivers; nothing is
+// polled, and a slow source never holds up the others in merge().
+// request() resumes the lane in place, so a synchronous source has its next
+// element ready before the combinator even yields the current one.
+//
+// Everything runs on the Loop thread. The combinator state is shared with
+// its lanes; dropping the stream stops every lane once it next wakes up.
+struct Readiness {
+  void notify(std::size_t lane) {
+    if (keep_order) {
+      ready.push_back(lane);
+    }
+    if (waiter && (!watched || *watched)) {
+      watched = nullptr;
+      get_global_loop().add_task(std::exchange(waiter, nullptr));
+    }
+  }
+
+  // Awaiter: wait() - until some lane is queued in 'ready' (keep_order)
+  //          wait_for(flag) - until one lane's 'arrived' flag is set
+  struct Awaiter {
+    bool await_ready() noexcept {
+      return watched ? *watched : !readiness->ready.empty();
+    }
+    void await_suspend(std::coroutine_handle<> combinator) {
+      readiness->waiter = combinator;
+      readiness->watched = watched;
+    }
+    void await_resume() noexcept {}
+
+    Readiness *readiness;
+    const bool *watched;
+  };
+
+  Awaiter wait() { return Awaiter{this, nullptr}; }
+  Awaiter wait_for(const bool &arrived) { return Awaiter{this, &arrived}; }
+
+  bool keep_order{false};         // merge(): arrival order is the output order
+  std::deque<std::size_t> ready;  // lanes in the order they reported
+  std::coroutine_handle<> waiter{nullptr};
+  const bool *watched{nullptr};
+  bool cancelled{false};
+};
+
+template <typename T> struct Lane {
+  explicit Lane(AsyncGenerator<T> source) : source(std::move(source)) {}
+
+  // request(): The combinator took 'item'; pull the next one
+  void request() {
+    arrived = false;
+    if (parked) {
+      std::exchange(parked, nullptr).resume();
+    }
+  }
+
+  struct ParkAwaiter {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> puller) { lane->parked = puller; }
+    void await_resume() noexcept {}
+
+    Lane *lane;
+  };
+
+  AsyncGenerator<T> source;
+  std::optional<T> item{std::nullopt};
+  bool arrived{false};  // 'item', the end or 'error' is here
+  bool ended{false};
+  std::exception_ptr error{nullptr};
+  std::coroutine_handle<> parked{nullptr};
+};
+
+// pull_lane(): The lane coroutine; 'keep' holds the combinator state
+template <typename T>
+Detached pull_lane([[maybe_unused]] std::shared_ptr<void> keep, Lane<T> &lane,
+                   Readiness &readiness, std::size_t index) {
+  while (!readiness.cancelled) {
+    try {
+      lane.item = co_await lane.source.next();
+    } catch (...) {
+      lane.error = std::current_exception();
+    }
+    if (readiness.cancelled) {
+      break;
+    }
+    lane.ended = !lane.item;
+    lane.arrived = true;
+    readiness.notify(index);
+    if (lane.ended) {
+      break;
+    }
+    co_await typename Lane<T>::ParkAwaiter{&lane};
+  }
+}
+
+// CombinatorHandle: Owned by the combinator's frame; cancels on drop
+template <typename State> struct CombinatorHandle {
+  explicit CombinatorHandle(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+  CombinatorHandle(CombinatorHandle &&) noexcept = default;
+
+  ~CombinatorHandle() {
+    if (state) {
+      state->readiness.cancelled = true;
+      state->for_each_lane([](auto &lane) { lane.request(); });
+    }
+  }
+
+  std::shared_ptr<State> state;
+};
+
+template <typename T> struct LaneGroup {
+  explicit LaneGroup(std::vector<AsyncGenerator<T>> sources) {
+    lanes.reserve(sources.size());
+    for (AsyncGenerator<T> &source : sources) {
+      lanes.emplace_back(std::move(source));
+    }
+  }
+
+  template <typename F> void for_each_lane(F f) {
+    for (Lane<T> &lane : lanes) {
+      f(lane);
+    }
+  }
+
+  // start(): Lanes only start once the state has reached its final address
+  static void start(const std::shared_ptr<LaneGroup> &state) {
+    for (std::size_t i = 0; i < state->lanes.size(); ++i) {
+      pull_lane(state, state->lanes[i], state->readiness, i);
+    }
+  }
+
+  Readiness readiness;
+  std::vector<Lane<T>> lanes;
+};
+
+// take_item(): Move the element out of an arrived lane and start the next
+// pull; rethrows the lane's exception
+template <typename T> std::optional<T> take_item(Lane<T> &lane) {
+  if (lane.error) {
+    std::rethrow_exception(std::exchange(lane.error, nullptr));
+  }
+  if (lane.ended) {
+    return std::nullopt;
+  }
+  std::optional<T> item = std::move(lane.item);
+  lane.item.reset();
+  lane.request();
+  return item;
+}
+
+template <typename T>
+AsyncGenerator<T> run_merge(CombinatorHandle<LaneGroup<T>> handle) {
+  LaneGroup<T> &state = *handle.state;
+  state.readiness.keep_order = true;
+  LaneGroup<T>::start(handle.state);
+  std::size_t live = state.lanes.size();
+  while (live != 0) {
+    co_await state.readiness.wait();
+    std::size_t index = state.readiness.ready.front();
+    state.readiness.ready.pop_front();
+    std::optional<T> item = take_item(state.lanes[index]);
+    if (!item) {
+      --live;
+      continue;
+    }
+    co_yield std::move(*item);
+  }
+}
+
+// merge(): From whichever source is ready first
+template <typename T> AsyncGenerator<T> merge(std::vector<AsyncGenerator<T>> sources) {
+  return run_merge(CombinatorHandle<LaneGroup<T>>(
+      std::make_shared<LaneGroup<T>>(std::move(sources))));
+}
+
+template <typename T, typename... Rest>
+  requires(std::is_same_v<Rest, AsyncGenerator<T>> && ...)
+AsyncGenerator<T> merge(AsyncGenerator<T> first, Rest... rest) {
+  std::vector<AsyncGenerator<T>> sources;
+  sources.push_back(std::move(first));
+  (sources.push_back(std::move(rest)), ...);
+  return merge(std::move(sources));
+}
+
+template <typename T>
+AsyncGenerator<T> run_interleave(CombinatorHandle<LaneGroup<T>> handle) {
+  LaneGroup<T> &state = *handle.state;
+  LaneGroup<T>::start(handle.state);
+  std::vector<std::size_t> rotation;  // lanes not finished yet
+  for (std::size_t index = 0; index < state.lanes.size(); ++index) {
+    rotation.push_back(index);
+  }
+  std::size_t turn = 0;
+  while (!rotation.empty()) {
+    turn %= rotation.size();
+    Lane<T> &lane = state.lanes[rotation[turn]];
+    co_await state.readiness.wait_for(lane.arrived);
+    std::optional<T> item = take_item(lane);
+    if (!item) {
+      rotation.erase(rotation.begin() + long(turn));
+      continue;
+    }
+    ++turn;
+    co_yield std::move(*item);
+  }
+}
+
+// interleave(): Round robin over the sources that are still running
+template <typename T>
+AsyncGenerator<T> interleave(std::vector<AsyncGenerator<T>> sources) {
+  return run_interleave(CombinatorHandle<LaneGroup<T>>(
+      std::make_shared<LaneGroup<T>>(std::move(sources))));
+}
+
+template <typename... Ts> struct ZipState {
+  explicit ZipState(AsyncGenerator<Ts>... sources) : lanes(std::move(sources)...) {}
+
+  template <typename F> void for_each_lane(F f) {
+    std::apply([&](auto &...lane) { (f(lane), ...); }, lanes);
+  }
+
+  static void start(const std::shared_ptr<ZipState> &state) {
+    std::size_t index = 0;
+    state->for_each_lane([&](auto &lane) {
+      pull_lane(state, lane, state->readiness, index++);
+    });
+  }
+
+  Readiness readiness;
+  std::tuple<Lane<Ts>...> lanes;
+};
+
+template <typename... Ts>
+AsyncGenerator<std::tuple<Ts...>> run_zip(CombinatorHandle<ZipState<Ts...>> handle) {
+  ZipState<Ts...> &state = *handle.state;
+  ZipState<Ts...>::start(handle.state);
+  std::vector<const bool *> arrived;
+  state.for_each_lane([&](auto &lane) { arrived.push_back(&lane.arrived); });
+  while (true) {
+    // All lanes are pulling concurrently; wait for each in turn
+    for (const bool *lane_arrived : arrived) {
+      co_await state.readiness.wait_for(*lane_arrived);
+    }
+    bool ended = false;
+    state.for_each_lane([&](auto &lane) {
+      if (lane.error) {
+        std::rethrow_exception(std::exchange(lane.error, nullptr));
+      }
+      ended = ended || lane.ended;
+    });
+    if (ended) {
+      break;
+    }
+    std::tuple<Ts...> row = std::apply(
+        [](auto &...lane) { return std::tuple<Ts...>(*take_item(lane)...); },
+        state.lanes);
+    co_yield std::move(row);
+  }
+}
+
+// zip(): One element of each source per row, until any source ends
+template <typename... Ts>
+AsyncGenerator<std::tuple<Ts...>> zip(AsyncGenerator<Ts>... sources) {
+  return run_zip(CombinatorHandle<ZipState<Ts...>>(
+      std::make_shared<ZipState<Ts...>>(std::move(sources)...)));
+}
+
+// LoserTree: k-way tournament over the lanes' current elements
+// - Leaves are the k sources; internal node n (1 <= n < k) keeps the loser
+//   of the match played there, node 0 the overall winner. Leaf i plays its
+//   first match at node (i + k) / 2, which works for any k
+// - After the winner's source delivers its next element, only the matches
+//   on that leaf's path are replayed: log2(k) comparisons per element,
+//   against k - 1 for scanning all heads
+// - A finished source loses every match; when the winner is finished, all are
+template <typename T, typename Compare> struct LoserTree {
+  LoserTree(std::vector<Lane<T>> &lanes, Compare compare)
+      : lanes(lanes), compare(std::move(compare)), tree(lanes.size(), none()) {
+    // Empty nodes hold 'none', which beats everything: each leaf inserted
+    // settles at the first empty node on its path
+    for (std::size_t leaf = lanes.size(); leaf-- > 0;) {
+      replay(leaf);
+    }
+  }
+
+  std::size_t winner() const { return tree[0]; }
+
+  void replay(std::size_t leaf) {
+    std::size_t winner = leaf;
+    for (std::size_t node = (leaf + tree.size()) / 2; node > 0; node /= 2) {
+      if (beats(tree[node], winner)) {
+        std::swap(tree[node], winner);
+      }
+    }
+    tree[0] = winner;
+  }
+
+private:
+  std::size_t none() const { return lanes.size(); }
+
+  bool beats(std::size_t a, std::size_t b) const {
+    if (a == none() || b == none()) {
+      return a == none();
+    }
+    const Lane<T> &left = lanes[a];
+    const Lane<T> &right = lanes[b];
+    if (!left.item || !right.item) {
+      return !right.item && (left.item || a < b);
+    }
+    if (compare(*left.item, *right.item)) {
+      return true;
+    }
+    return !compare(*right.item, *left.item) && a < b;
+  }
+
+  std::vector<Lane<T>> &lanes;
+  Compare compare;
+  std::vector<std::size_t> tree;
+};
+
+template <typename T, typename Compare>
+AsyncGenerator<T> run_merge_sorted(CombinatorHandle<LaneGroup<T>> handle,
+                                   Compare compare) {
+  LaneGroup<T> &state = *handle.state;
+  if (state.lanes.empty()) {
+    co_return;
+  }
+  LaneGroup<T>::start(handle.state);
+
+  // Every source's first element is needed before the first match
+  for (Lane<T> &lane : state.lanes) {
+    co_await state.readiness.wait_for(lane.arrived);
+    if (lane.error) {
+      std::rethrow_exception(std::exchange(lane.error, nullptr));
+    }
+  }
+
+  LoserTree<T, Compare> tree(state.lanes, std::move(compare));
+  while (true) {
+    std::size_t winner = tree.winner();
+    Lane<T> &lane = state.lanes[winner];
+    std::optional<T> item = take_item(lane);
+    if (!item) {
+      break;
+    }
+    co_yield std::move(*item);
+    co_await state.readiness.wait_for(lane.arrived);
+    if (lane.error) {
+      std::rethrow_exception(std::exchange(lane.error, nullptr));
+    }
+    tree.replay(winner);
+  }
+}
+
+// merge_sorted(): Each source must already be sorted by 'compare'
+template <typename T, typename Compare = std::less<>>
+AsyncGenerator<T> merge_sorted(std::vector<AsyncGenerator<T>> sources,
+                               Compare compare = {}) {
+  return run_merge_sorted(CombinatorHandle<LaneGroup<T>>(std::make_shared<LaneGroup<T>>(
+                              std::move(sources))),
+                          std::move(compare));
+}
+
+// ==============================================================================
+// mapped_file: Stream a file through mmap, one window per co_yield
+// ==============================================================================
+// A read()-based source copies every byte from the page cache into its
+// buffer. mapped_file() maps the file instead and yields spans that point
+// straight into the mapping, so consumers read the page cache in place:
+//
+//   BatchGenerator<const std::byte> windows = mapped_file("big.log");
+//   while (auto window = co_await windows.next()) { ... }
+//
+// Paging is steered with madvise():
+// - MADV_SEQUENTIAL on the whole mapping: aggressive kernel read-ahead, and
+//   pages behind the reader may be reclaimed early
+// - MADV_WILLNEED on the next 'read_ahead' bytes, renewed as the reader
+//   moves, so the pages are read in before the consumer faults on them
+// - MADV_DONTNEED on each window once the consumer asks for the next one:
+//   it leaves our resident set (the page cache keeps it), so the RSS stays
+//   around read_ahead + window however large the file is
+//
+// As with any BatchGenerator, a window is only valid until the next next().
+// Windows are whole pages (the window size is rounded up), because madvise()
+// works on pages. A file changed or truncated while mapped can make the
+// reader fault (SIGBUS); use this on files that are only appended to or not
+// written at all.
+struct MappedFileOptions {
+  std::size_t window{1 << 20};
+  std::size_t read_ahead{16 << 20};
+  bool drop_consumed{true};
+};
+
+// MappedFile: A read-only mapping of a whole file
+struct MappedFile {
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat status {};
+    if (fstat(fd, &status) < 0) {
+      int error = errno;
+      close(fd);
+      throw std::system_error(error, std::generic_category(), "fstat " + path);
+    }
+    size = std::size_t(status.st_size);
+    if (size != 0) {
+      void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "mmap " + path);
+      }
+      data = static_cast<const std::byte *>(mapped);
+    }
+    close(fd);  // the mapping keeps the file open
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (data) {
+      munmap(const_cast<std::byte *>(data), size);
+    }
+  }
+
+  // advise(): madvise() on [offset, offset + length), clipped to the file
+  // - Only a hint; failures are ignored
+  void advise(std::size_t offset, std::size_t length, int advice) const {
+    if (offset < size) {
+      madvise(const_cast<std::byte *>(data) + offset,
+              std::min(length, size - offset), advice);
+    }
+  }
+
+  const std::byte *data{nullptr};
+  std::size_t size{0};
+};
+
+BatchGenerator<const std::byte> mapped_file(std::string path,
+                                            MappedFileOptions options = {}) {
+  const std::size_t page = std::size_t(sysconf(_SC_PAGESIZE));
+  const std::size_t window = (std::max(options.window, page) + page - 1) / page * page;
+  const std::size_t read_ahead = std::max(options.read_ahead, window);
+
+  MappedFile file(path);
+  file.advise(0, file.size, MADV_SEQUENTIAL);
+  std::size_t advised = 0;  // WILLNEED has been issued up to here
+  for (std::size_t offset = 0; offset < file.size; offset += window) {
+    // Renew WILLNEED in steps of half the read-ahead, not on every window
+    if (advised < offset + read_ahead / 2) {
+      std::size_t until = offset + read_ahead;
+      file.advise(advised, until - advised, MADV_WILLNEED);
+      advised = until;
+    }
+    std::size_t length = std::min(window, file.size - offset);
+    co_yield std::span<const std::byte>(file.data + offset, length);
+    if (options.drop_consumed) {
+      file.advise(offset, length, MADV_DONTNEED);
+    }
+  }
+}
+
+// ==============================================================================
+// split_lines / split_records: Zero-copy framing over byte chunks
+// ==============================================================================
+//   AsyncGenerator<std::string_view> lines = split_lines(mapped_file(path));
+//   AsyncGenerator<std::string_view> records = split_records(chunks);
+//
+// A line (without its '\n'; a '\r' before it is kept) or a record payload
+// that lies inside one chunk is yielded as a view into that chunk, so
+// nothing is copied. Only one that straddles a chunk boundary is assembled
+// in the splitter's carry buffer, and only its own bytes are copied.
+// Views are valid until the next next(), as the chunk they point into is
+// only valid until the splitter pulls the next one.
+//
+// Records are length-prefixed: a 4-byte little-endian payload length, then
+// the payload. A length above 'max_record' or a stream that ends inside a
+// record throws std::runtime_error.
+//
+// Newline scan: Calling memchr() once per line costs a call and a short
+// scan per line, which for typical log lines is a large part of the work.
+// find_newlines() instead scans 32 bytes per step with AVX2, turns the
+// comparison into a bit mask and reads the positions out of it, collecting
+// the offsets of many lines per call. Without AVX2 (or with
+// force_scalar_kernels) it falls back to a memchr() loop.
+
+// find_newlines(): Offsets of the first out.size() '\n' at or after 'from'
+// - Returns how many were found; fewer than out.size() means the scan
+//   reached the end of 'text'
+std::size_t find_newlines_scalar(std::string_view text, std::size_t from,
+                                 std::span<std::size_t> out) {
+  std::size_t count = 0;
+  while (count < out.size() && from < text.size()) {
+    const void *found = std::memchr(text.data() + from, '\n', text.size() - from);
+    if (!found) {
+      break;
+    }
+    std::size_t at = std::size_t(static_cast<const char *>(found) - text.data());
+    out[count++] = at;
+    from = at + 1;
+  }
+  return count;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,bmi"))) std::size_t
+find_newlines_avx2(std::string_view text, std::size_t from,
+                   std::span<std::size_t> out) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  std::size_t count = 0;
+  for (; from + 32 <= text.size(); from += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text.data() + from));
+    auto mask = std::uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)));
+    while (mask != 0) {
+      if (count == out.size()) {
+        return count;
+      }
+      out[count++] = from + std::size_t(std::countr_zero(mask));
+      mask &= mask - 1;
+    }
+  }
+  return count + find_newlines_scalar(text, from, out.subspan(count));
+}
+#endif
+
+std::size_t find_newlines(std::string_view text, std::size_t from,
+                          std::span<std::size_t> out) {
+#if defined(__x86_64__)
+  if (use_simd_kernels()) {
+    return find_newlines_avx2(text, from, out);
+  }
+#endif
+  return find_newlines_scalar(text, from, out);
+}
+
+std::string_view as_chars(std::span<const std::byte> bytes) {
+  return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+}
+
+AsyncGenerator<std::string_view> split_lines(BatchGenerator<const std::byte> chunks) {
+  std::string carry;  // the start of a line from earlier chunks
+  std::array<std::size_t, 256> newlines;
+  while (auto chunk = co_await chunks.next()) {
+    std::string_view text = as_chars(*chunk);
+    std::size_t start = 0;  // first byte of the current line
+    while (true) {
+      std::size_t found = find_newlines(text, start, newlines);
+      for (std::size_t i = 0; i < found; ++i) {
+        std::size_t end = newlines[i];
+        if (carry.empty()) {
+          co_yield text.substr(start, end - start);
+        } else {
+          carry.append(text, start, end - start);
+          co_yield std::string_view(carry);
+          carry.clear();
+        }
+        start = end + 1;
+      }
+      if (found < newlines.size()) {
+        break;
+      }
+    }
+    carry.append(text, start);
+  }
+  if (!carry.empty()) {
+    co_yield std::string_view(carry);  // last line without a '\n'
+  }
+}
+
+// record_length(): The 4-byte little-endian length prefix at 'at'
+std::uint32_t record_length(const char *at) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(at);
+  return std::uint32_t(bytes[0]) | std::uint32_t(bytes[1]) << 8 |
+         std::uint32_t(bytes[2]) << 16 | std::uint32_t(bytes[3]) << 24;
+}
+
+AsyncGenerator<std::string_view> split_records(BatchGenerator<const std::byte> chunks,
+                                               std::size_t max_record = 64 << 20) {
+  constexpr std::size_t header = 4;
+  auto checked_length = [max_record](const char *at) {
+    std::size_t length = record_length(at);
+    if (length > max_record) {
+      throw std::runtime_error("split_records: record of " + std::to_string(length) +
+                               " bytes is over the limit");
+    }
+    return length;
+  };
+
+  std::string carry;  // a header and/or record started in earlier chunks
+  while (auto chunk = co_await chunks.next()) {
+    std::string_view text = as_chars(*chunk);
+    std::size_t at = 0;
+
+    // 1. Finish the straddling record first
+    if (!carry.empty()) {
+      if (carry.size() < header) {
+        std::size_t take = std::min(header - carry.size(), text.size());
+        carry.append(text, 0, take);
+        at = take;
+        if (carry.size() < header) {
+          continue;
+        }
+      }
+      std::size_t missing = header + checked_length(carry.data()) - carry.size();
+      std::size_t take = std::min(missing, text.size() - at);
+      carry.append(text, at, take);
+      at += take;
+      if (take < missing) {
+        continue;
+      }
+      co_yield std::string_view(carry).substr(header);
+      carry.clear();
+    }
+
+    // 2. Records that lie entirely inside this chunk
+    while (text.size() - at >= header) {
+      std::size_t length = checked_length(text.data() + at);
+      if (text.size() - at - header < length) {
+        break;
+      }
+      co_yield text.substr(at + header, length);
+      at += header + length;
+    }
+    carry.assign(text, at);
+  }
+  if (!carry.empty()) {
+    throw std::runtime_error("split_records: stream ends inside a record");
+  }
+}
+
+// ==============================================================================
+// Demo: fused vs one-frame-per-stage
+// ==============================================================================
+AsyncGenerator<long> numbers(long count) {
+  for (long i = 0; i < count; ++i) {
+    co_yield i;
+  }
+}
+
+// consume(): Sum every element of every chunk
+Task<long> consume(AsyncGenerator<std::vector<long>> batches) {
+  long total = 0;
+  while (auto batch = co_await batches.next()) {
+    for (long value : *batch) {
+      total += value;
+    }
+  }
+  co_return total;
+}
+
+auto square = [](long x) { return x * x; };
+auto is_even = [](long x) { return x % 2 == 0; };
+auto plus_one = [](long x) { return x + 1; };
+
+// parse_record(): CPU-heavy per-item work (a few tens of microseconds)
+// - Item 0 of every 16 is ten times slower, to show the reorder ring at work
+struct Record {
+  long id;
+  std::uint64_t checksum;
+};
+
+Record parse_record(long id) {
+  std::uint64_t hash = 1469598103934665603ull ^ std::uint64_t(id);
+  int rounds = id % 16 == 0 ? 200'000 : 20'000;
+  for (int i = 0; i < rounds; ++i) {
+    hash = (hash ^ std::uint64_t(i)) * 1099511628211ull;
+  }
+  return Record{id, hash};
+}
+
+// collect(): Ids in output order, and a checksum independent of the order
+Task<std::pair<std::vector<long>, std::uint64_t>>
+collect(AsyncGenerator<Record> records) {
+  std::vector<long> ids;
+  std::uint64_t checksum = 0;
+  while (auto record = co_await records.next()) {
+    ids.push_back(record->id);
+    checksum += record->checksum;
+  }
+  co_return std::make_pair(std::move(ids), checksum);
+}
+
+template <typename Build> void parse_benchmark(const char *name, Build build) {
+  constexpr long count = 2'000;
+  auto start = std::chrono::steady_clock::now();
+  auto [ids, checksum] = run_on_loop(collect(build(numbers(count))));
+  auto elapsed = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start);
+
+  bool in_order = std::is_sorted(ids.begin(), ids.end());
+  std::size_t moved = 0;
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    moved += ids[i] != long(i);
+  }
+  std::cout << name << ": " << ids.size() << " records, checksum " << checksum
+            << " in " << elapsed.count() << " ms, "
+            << (in_order ? "in input order"
+                         : std::to_string(moved) + " out of place")
+            << std::endl;
+}
+
+BatchGenerator<long> run_number_batches(long count, std::span<long> buffer) {
+  const long size = long(buffer.size());
+  for (long base = 0; base < count; base += size) {
+    std::size_t filled = std::size_t(std::min(size, count - base));
+    for (std::size_t i = 0; i < filled; ++i) {
+      buffer[i] = base + long(i);
+    }
+    co_yield buffer.first(filled);
+  }
+}
+
+// number_batches(): numbers(count), a buffer at a time
+BatchGenerator<long> number_batches(long count, std::span<long> buffer) {
+  if (buffer.empty()) {
+    throw std::invalid_argument("number_batches: empty buffer");
+  }
+  return run_number_batches(count, buffer);
+}
+
+Task<long> sum_elements(AsyncGenerator<long> numbers) {
+  long total = 0;
+  while (auto value = co_await numbers.next()) {
+    total += *value;
+  }
+  co_return total;
+}
+
+Task<long> sum_batches(BatchGenerator<long> batches) {
+  long total = 0;
+  while (auto batch = co_await batches.next()) {
+    for (long value : *batch) {
+      total += value;
+    }
+  }
+  co_return total;
+}
+
+template <typename Make> void batch_benchmark(const char *name, Make make) {
+  constexpr long count = 10'000'000;
+  GeneratorPromise<long>::resumes = 0;
+  GeneratorPromise<std::span<long>>::resumes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  long total = run_on_loop(make(count));
+  auto elapsed = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start);
+
+  std::size_t resumes = GeneratorPromise<long>::resumes +
+                        GeneratorPromise<std::span<long>>::resumes;
+  std::cout << name << ": total " << total << ", "
+            << elapsed.count() / double(count) << " ns per element, "
+            << resumes << " generator resumes" << std::endl;
+}
+
+// Metrics: request latencies in microseconds, generated up front so the
+// benchmark measures consumption and not the random number generator
+std::vector<std::int32_t> make_latencies(std::size_t count) {
+  std::vector<std::int32_t> latencies(count);
+  std::uint64_t state = 88172645463325252ull;
+  for (std::int32_t &latency : latencies) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    latency = std::int32_t(state % 12'000);  // up to 12ms, some above hi
+  }
+  return latencies;
+}
+
+AsyncGenerator<std::int32_t> latency_values(const std::vector<std::int32_t> &data) {
+  for (std::int32_t latency : data) {
+    co_yield latency;
+  }
+}
+
+BatchGenerator<std::int32_t> latency_batches(const std::vector<std::int32_t> &data,
+                                             std::span<std::int32_t> buffer) {
+  for (std::size_t base = 0; base < data.size(); base += buffer.size()) {
+    std::size_t filled = std::min(buffer.size(), data.size() - base);
+    std::copy_n(data.begin() + long(base), filled, buffer.begin());
+    co_yield buffer.first(filled);
+  }
+}
+
+using MetricReducers =
+    std::tuple<Sum<std::int32_t>, MinMax<std::int32_t>,
+               CountIf<Compare<std::int32_t>>, Histogram<std::int32_t>>;
+
+MetricReducers metric_reducers() {
+  return {Sum<std::int32_t>{}, MinMax<std::int32_t>{},
+          CountIf{greater_than<std::int32_t>(10'000)},
+          Histogram<std::int32_t>(0, 10'000, 20)};
+}
+
+// aggregate_elements(): The per-element baseline, one resume per value
+Task<MetricReducers> aggregate_elements(AsyncGenerator<std::int32_t> values) {
+  MetricReducers reducers = metric_reducers();
+  auto &[sum, range, slow, histogram] = reducers;
+  while (auto value = co_await values.next()) {
+    sum.value += *value;
+    range.range.min = std::min(range.range.min, *value);
+    range.range.max = std::max(range.range.max, *value);
+    slow.count += slow.predicate(*value);
+    ++histogram.counts[bucket_of(double(*value), histogram.spec)];
+  }
+  co_return reducers;
+}
+
+Task<MetricReducers> aggregate_batches(BatchGenerator<std::int32_t> batches) {
+  co_return co_await std::apply(
+      [&](auto... reducers) { return reduce(std::move(batches), reducers...); },
+      metric_reducers());
+}
+
+template <typename Make>
+MetricReducers metrics_benchmark(const char *name, std::size_t count, Make make) {
+  auto start = std::chrono::steady_clock::now();
+  MetricReducers result = run_on_loop(make());
+  auto elapsed = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start);
+  const auto &[sum, range, slow, histogram] = result;
+  std::cout << name << ": " << elapsed.count() / double(count)
+            << " ns per value (sum " << sum.value << ", min " << range.range.min
+            << ", max " << range.range.max << ", >10ms " << slow.count
+            << ", last bucket " << histogram.counts[20] << ")" << std::endl;
+  return result;
+}
+
+// check_double_kernels(): AVX2 and scalar agree on doubles, tails included
+bool check_double_kernels() {
+  std::vector<double> values;
+  for (int i = 0; i < 1003; ++i) {
+    values.push_back((i * 37 % 101) - 20.5);
+  }
+  auto run = [&](bool scalar) {
+    force_scalar_kernels = scalar;
+    Sum<double> sum;
+    MinMax<double> range;
+    CountIf count{less_than(0.0)};
+    Histogram<double> histogram(-10.0, 60.0, 7);
+    for (std::size_t i = 0; i < values.size(); i += 250) {
+      std::span<const double> batch = std::span<const double>(values).subspan(
+          i, std::min<std::size_t>(250, values.size() - i));
+      sum.add(batch);
+      range.add(batch);
+      count.add(batch);
+      histogram.add(batch);
+    }
+    force_scalar_kernels = false;
+    return std::make_tuple(sum.value, range.range.min, range.range.max,
+                           count.count, histogram.counts);
+  };
+  return run(true) == run(false);  // small integers-plus-half: sums are exact
+}
+
+// blocking_blocks(): A producer that blocks the thread resuming it, like a
+// pread() or a decompression call: 1ms per 4 KiB block
+AsyncGenerator<std::vector<std::uint8_t>> blocking_blocks(int count) {
+  for (int block = 0; block < count; ++block) {
+    std::this_thread::sleep_for(1ms);
+    co_yield std::vector<std::uint8_t>(4096, std::uint8_t(block));
+  }
+}
+
+// checksum_blocks(): A consumer that spends ~1ms of CPU per block
+Task<std::uint64_t>
+checksum_blocks(AsyncGenerator<std::vector<std::uint8_t>> blocks) {
+  std::uint64_t checksum = 0;
+  while (auto block = co_await blocks.next()) {
+    auto until = std::chrono::steady_clock::now() + 1ms;
+    while (std::chrono::steady_clock::now() < until) {
+    }
+    for (std::uint8_t byte : *block) {
+      checksum = checksum * 31 + byte;
+    }
+  }
+  co_return checksum;
+}
+
+template <typename Build> void read_ahead_benchmark(const char *name, Build build) {
+  constexpr int blocks = 200;
+  auto start = std::chrono::steady_clock::now();
+  std::uint64_t checksum = run_on_loop(checksum_blocks(build(blocking_blocks(blocks))));
+  auto elapsed = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << name << ": checksum " << checksum << " in " << elapsed.count()
+            << " ms" << std::endl;
+}
+
+// ticks(): An async source producing every 'period'
+AsyncGenerator<std::string> ticks(std::string name, std::chrono::milliseconds period,
+                                  int count) {
+  for (int i = 1; i <= count; ++i) {
+    co_await sleep_for(period);
+    co_yield name + std::to_string(i);
+  }
+}
+
+AsyncGenerator<int> counting(int from, int count) {
+  for (int i = from; i < from + count; ++i) {
+    co_yield i;
+  }
+}
+
+Task<> combinators_demo() {
+  AsyncGenerator<std::string> merged =
+      merge(ticks("fast", 2ms, 4), ticks("slow", 5ms, 2), ticks("mid", 3ms, 3));
+  std::cout << "merge:     ";
+  while (auto tick = co_await merged.next()) {
+    std::cout << " " << *tick;
+  }
+
+  AsyncGenerator<std::tuple<int, std::string>> zipped =
+      zip(counting(1, 10), ticks("t", 1ms, 3));
+  std::cout << "\nzip:       ";
+  while (auto row = co_await zipped.next()) {
+    std::cout << " (" << std::get<0>(*row) << ", " << std::get<1>(*row) << ")";
+  }
+
+  std::vector<AsyncGenerator<int>> sources;
+  sources.push_back(counting(0, 3));
+  sources.push_back(counting(100, 1));
+  sources.push_back(counting(200, 4));
+  AsyncGenerator<int> interleaved = interleave(std::move(sources));
+  std::cout << "\ninterleave:";
+  while (auto value = co_await interleaved.next()) {
+    std::cout << " " << *value;
+  }
+  std::cout << std::endl;
+}
+
+// log_timestamps(): One service's log, already sorted by timestamp
+AsyncGenerator<long> log_timestamps(std::uint64_t seed, int count) {
+  long timestamp = 0;
+  for (int i = 0; i < count; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    timestamp += 1 + long(seed >> 58);
+    co_yield timestamp;
+  }
+}
+
+std::vector<AsyncGenerator<long>> service_logs(int services, int lines) {
+  std::vector<AsyncGenerator<long>> logs;
+  for (int service = 0; service < services; ++service) {
+    logs.push_back(log_timestamps(std::uint64_t(service) * 7919 + 1, lines));
+  }
+  return logs;
+}
+
+struct MergedLog {
+  std::size_t lines{0};
+  std::uint64_t checksum{0};
+  bool sorted{true};
+
+  void add(long timestamp, long previous) {
+    sorted = sorted && (lines == 0 || previous <= timestamp);
+    checksum = checksum * 1000003 + std::uint64_t(timestamp);
+    ++lines;
+  }
+};
+
+// scan_merge(): The naive k-way merge, k - 1 comparisons per line
+Task<MergedLog> scan_merge(std::vector<AsyncGenerator<long>> logs) {
+  std::vector<std::optional<long>> heads;
+  for (AsyncGenerator<long> &log : logs) {
+    heads.push_back(co_await log.next());
+  }
+  MergedLog merged;
+  long previous = 0;
+  while (true) {
+    std::size_t best = heads.size();
+    for (std::size_t i = 0; i < heads.size(); ++i) {
+      if (heads[i] && (best == heads.size() || *heads[i] < *heads[best])) {
+        best = i;
+      }
+    }
+    if (best == heads.size()) {
+      break;
+    }
+    merged.add(*heads[best], previous);
+    previous = *heads[best];
+    heads[best] = co_await logs[best].next();
+  }
+  co_return merged;
+}
+
+Task<MergedLog> tree_merge(std::vector<AsyncGenerator<long>> logs) {
+  AsyncGenerator<long> lines = merge_sorted(std::move(logs));
+  MergedLog merged;
+  long previous = 0;
+  while (auto timestamp = co_await lines.next()) {
+    merged.add(*timestamp, previous);
+    previous = *timestamp;
+  }
+  co_return merged;
+}
+
+template <typename Merge> void merge_benchmark(const char *name, Merge merge_logs) {
+  constexpr int services = 256;
+  constexpr int lines = 4'000;
+  auto start = std::chrono::steady_clock::now();
+  MergedLog merged = run_on_loop(merge_logs(service_logs(services, lines)));
+  auto elapsed = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << name << ": " << merged.lines << " lines"
+            << (merged.sorted ? ", sorted" : ", NOT sorted") << ", checksum "
+            << merged.checksum << " in " << elapsed.count() << " ms" << std::endl;
+}
+
+// resident_bytes(): This process's current RSS, from /proc/self/statm
+std::size_t resident_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * std::size_t(sysconf(_SC_PAGESIZE));
+}
+
+// write_test_file(): 'size' bytes of text lines for the file demos
+void write_test_file(const std::string &path, std::size_t size) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  std::string line;
+  for (std::size_t written = 0, n = 0; written < size; written += line.size(), ++n) {
+    line = "2024-05-01T12:00:" + std::to_string(n % 60) + " host" +
+           std::to_string(n % 97) + (n % 13 == 0 ? " ERROR " : " INFO ") +
+           "request " + std::to_string(n * 2654435761u % 1000003) + " done\n";
+    out << line;
+  }
+}
+
+struct ScanResult {
+  std::uint64_t checksum{0};
+  std::size_t bytes{0};
+  std::size_t peak_rss_growth{0};
+};
+
+// checksum_bytes(): Touches every byte, like a parser would
+std::uint64_t checksum_bytes(std::span<const std::byte> bytes) {
+  std::uint64_t sum = 0;
+  for (std::byte byte : bytes) {
+    sum += std::uint64_t(byte);
+  }
+  return sum;
+}
+
+Task<ScanResult> scan_windows(BatchGenerator<const std::byte> windows) {
+  ScanResult result;
+  std::size_t baseline = resident_bytes();
+  while (auto window = co_await windows.next()) {
+    result.checksum += checksum_bytes(*window);
+    result.bytes += window->size();
+    std::size_t resident = resident_bytes();
+    result.peak_rss_growth = std::max(result.peak_rss_growth,
+                                      resident - std::min(baseline, resident));
+  }
+  co_return result;
+}
+
+// read_windows(): The copying alternative, read() into one reused buffer
+BatchGenerator<const std::byte> read_windows(std::string path,
+                                             std::span<std::byte> buffer) {
+  std::ifstream in(path, std::ios::binary);
+  auto *data = reinterpret_cast<char *>(buffer.data());
+  while (in.read(data, std::streamsize(buffer.size())) || in.gcount() > 0) {
+    co_yield std::span<const std::byte>(buffer.first(std::size_t(in.gcount())));
+  }
+}
+
+template <typename Make>
+ScanResult file_scan_benchmark(const char *name, Make make) {
+  auto start = std::chrono::steady_clock::now();
+  ScanResult result = run_on_loop(scan_windows(make()));
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << name << ": " << double(result.bytes) / (1 << 20) / seconds
+            << " MiB/s, peak RSS growth " << result.peak_rss_growth / (1 << 20)
+            << " MiB, checksum " << result.checksum << std::endl;
+  return result;
+}
+
+// getline_lines(): The copying splitter, one std::string per line
+AsyncGenerator<std::string> getline_lines(std::string path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string line;
+  while (std::getline(in, line)) {
+    co_yield line;
+  }
+}
+
+struct LineStats {
+  std::size_t lines{0};
+  std::size_t bytes{0};
+};
+
+template <typename Line> Task<LineStats> count_lines(AsyncGenerator<Line> lines) {
+  LineStats stats;
+  while (auto line = co_await lines.next()) {
+    ++stats.lines;
+    stats.bytes += line->size();
+  }
+  co_return stats;
+}
+
+template <typename Make> void split_benchmark(const char *name, Make make) {
+  auto start = std::chrono::steady_clock::now();
+  LineStats stats = run_on_loop(count_lines(make()));
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << name << ": " << stats.lines << " lines, " << stats.bytes
+            << " bytes, " << double(stats.lines) / seconds / 1e6 << "M lines/s"
+            << std::endl;
+}
+
+// memory_chunks(): Bytes in memory, cut into chunks of 'size'
+BatchGenerator<const std::byte> memory_chunks(std::span<const std::byte> bytes,
+                                              std::size_t size) {
+  for (std::size_t at = 0; at < bytes.size(); at += size) {
+    co_yield bytes.subspan(at, std::min(size, bytes.size() - at));
+  }
+}
+
+// records_round_trip(): Encode records, split them back out of chunks of
+// several sizes, and count how many come back intact
+Task<> records_round_trip() {
+  std::vector<std::string> records;
+  std::string encoded;
+  for (int i = 0; i < 10'000; ++i) {
+    std::string record(std::size_t(i * 7919 % 301), char('a' + i % 26));
+    auto length = std::uint32_t(record.size());
+    for (int shift = 0; shift < 32; shift += 8) {
+      encoded.push_back(char((length >> shift) & 0xff));
+    }
+    encoded += record;
+    records.push_back(std::move(record));
+  }
+  auto bytes = std::as_bytes(std::span(encoded.data(), encoded.size()));
+  for (std::size_t chunk_size : {std::size_t(1), std::size_t(7), std::size_t(4096)}) {
+    AsyncGenerator<std::string_view> split =
+        split_records(memory_chunks(bytes, chunk_size));
+    std::size_t intact = 0;
+    std::size_t index = 0;
+    while (auto record = co_await split.next()) {
+      intact += index < records.size() && *record == records[index];
+      ++index;
+    }
+    std::cout << "records in " << chunk_size << "-byte chunks: " << intact << " of "
+              << records.size() << " intact" << std::endl;
+  }
+}
+
+template <typename Build> void pipeline_benchmark(const char *name, Build build) {
+  constexpr long count = 2'000'000;
+  GeneratorPromise<long>::resumes = 0;
+  GeneratorPromise<std::vector<long>>::resumes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  long total = run_on_loop(consume(build(numbers(count))));
+  auto elapsed = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start);
+
+  std::size_t resumes = GeneratorPromise<long>::resumes +
+                        GeneratorPromise<std::vector<long>>::resumes;
+  std::cout << name << ": total " << total << " in " << elapsed.count()
+            << " ms, " << resumes << " generator resumes" << std::endl;
+}
+
+// lines_of(): An async source, e.g. reading a file that arrives slowly
+AsyncGenerator<std::string> lines_of(std::string file) {
+  for (int line = 1; line <= 2; ++line) {
+    co_await sleep_for(1ms);
+    co_yield file + ":" + std::to_string(line);
+  }
+}
+
+AsyncGenerator<std::string> file_names() {
+  co_yield std::string("a.log");
+  co_yield std::string("b.log");
+  co_yield std::string("c.log");
+}
+
+Task<> print_lines() {
+  AsyncGenerator<std::string> lines =
+      file_names() | filter([](const std::string &f) { return f != "b.log"; }) |
+      flat_map(lines_of) |
+      map([](std::string line) { return "[" + line + "]"; });
+  while (auto line = co_await lines.next()) {
+    std::cout << *line << std::endl;
+  }
+}
+
+int main() {
+  std::cout << "=== flat_map over an async source ===" << std::endl;
+  run_on_loop(print_lines());
+
+  // map -> filter -> map -> take -> chunk, five synchronous stages
+  std::cout << "\n=== Five-stage pipeline ===" << std::endl;
+  pipeline_benchmark("fused     ", [](AsyncGenerator<long> source) {
+    return to_generator(std::move(source) | map(square) | filter(is_even) |
+                        map(plus_one) | take(500'000) | chunk(64));
+  });
+  pipeline_benchmark("per stage ", [](AsyncGenerator<long> source) {
+    // Converting after every operator gives each stage its own frame
+    AsyncGenerator<long> squared = std::move(source) | map(square);
+    AsyncGenerator<long> even = std::move(squared) | filter(is_even);
+    AsyncGenerator<long> shifted = std::move(even) | map(plus_one);
+    AsyncGenerator<long> first = std::move(shifted) | take(500'000);
+    return to_generator(std::move(first) | chunk(64));
+  });
+
+  // One element per co_yield vs a 4096-element span per co_yield
+  std::cout << "\n=== Batched co_yield ===" << std::endl;
+  batch_benchmark("co_yield long          ", [](long count) {
+    return sum_elements(numbers(count));
+  });
+  std::vector<long> buffer(4096);
+  batch_benchmark("co_yield span<long>    ", [&buffer](long count) {
+    return sum_batches(number_batches(count, buffer));
+  });
+  batch_benchmark("batch_into(numbers)    ", [&buffer](long count) {
+    return sum_batches(batch_into(numbers(count), std::span<long>(buffer)));
+  });
+
+  // Metric aggregation: per-element vs batched scalar vs batched AVX2
+  std::cout << "\n=== Stream reducers ===" << std::endl;
+  {
+    constexpr std::size_t count = 20'000'000;
+    std::vector<std::int32_t> latencies = make_latencies(count);
+    std::vector<std::int32_t> metric_buffer(4096);
+    auto per_element = metrics_benchmark("per element        ", count, [&] {
+      return aggregate_elements(latency_values(latencies));
+    });
+    force_scalar_kernels = true;
+    auto scalar = metrics_benchmark("batches, scalar    ", count, [&] {
+      return aggregate_batches(latency_batches(latencies, metric_buffer));
+    });
+    force_scalar_kernels = false;
+    auto simd = metrics_benchmark(
+        use_simd_kernels() ? "batches, AVX2      " : "batches (no AVX2)  ", count,
+        [&] { return aggregate_batches(latency_batches(latencies, metric_buffer)); });
+
+    auto summary = [](const MetricReducers &r) {
+      const auto &[sum, range, slow, histogram] = r;
+      return std::make_tuple(sum.value, range.range.min, range.range.max,
+                             slow.count, histogram.counts);
+    };
+    bool agree = summary(per_element) == summary(scalar) &&
+                 summary(scalar) == summary(simd) && check_double_kernels();
+    std::cout << "kernels agree: " << (agree ? "yes" : "NO") << std::endl;
+  }
+
+  // A blocking producer and a CPU-bound consumer, 1ms each per block
+  std::cout << "\n=== read_ahead ===" << std::endl;
+  read_ahead_benchmark("pull on demand", [](auto source) { return source; });
+  read_ahead_benchmark("read_ahead(8) ", [](auto source) {
+    return std::move(source) | read_ahead(8);
+  });
+
+  // Several producers into one stream
+  std::cout << "\n=== merge / zip / interleave ===" << std::endl;
+  run_on_loop(combinators_demo());
+  merge_benchmark("scan 256 heads ", scan_merge);
+  merge_benchmark("merge_sorted   ", tree_merge);
+
+  // Streaming a file: read() into a buffer vs mmap windows
+  // - 32 MiB by default; GENERATOR_PIPELINE_FILE_MIB=512 makes the RSS
+  //   difference between keeping and dropping consumed pages stand out
+  std::cout << "\n=== mapped_file ===" << std::endl;
+  {
+    std::size_t file_mib = 32;
+    if (const char *env = std::getenv("GENERATOR_PIPELINE_FILE_MIB")) {
+      file_mib = std::max<std::size_t>(std::strtoul(env, nullptr, 10), 1);
+    }
+    const std::string path = "/tmp/generator-pipeline-mapped.log";
+    write_test_file(path, file_mib << 20);
+    std::vector<std::byte> read_buffer(1 << 20);
+    file_scan_benchmark("read() into a buffer        ", [&] {
+      return read_windows(path, read_buffer);
+    });
+    file_scan_benchmark("mmap, consumed pages kept   ", [&] {
+      return mapped_file(path, {.drop_consumed = false});
+    });
+    file_scan_benchmark("mmap, consumed pages dropped", [&] {
+      return mapped_file(path);
+    });
+
+    // Splitting the same file into lines
+    std::cout << "\n=== split_lines / split_records ===" << std::endl;
+    split_benchmark("std::getline, copies      ", [&] { return getline_lines(path); });
+    force_scalar_kernels = true;
+    split_benchmark("split_lines, memchr       ", [&] {
+      return split_lines(mapped_file(path));
+    });
+    force_scalar_kernels = false;
+    split_benchmark(use_simd_kernels() ? "split_lines, AVX2 bitmask "
+                                       : "split_lines (no AVX2)     ",
+                    [&] { return split_lines(mapped_file(path)); });
+    unlink(path.c_str());
+  }
+  run_on_loop(records_round_trip());
+
+  // A CPU-heavy parse stage on the worker pool
+  std::cout << "\n=== parallel_map on " << get_worker_pool().size()
+            << " worker threads ===" << std::endl;
+  parse_benchmark("serial map        ", [](AsyncGenerator<long> source) {
+    return to_generator(std::move(source) | map(parse_record));
+  });
+  std::size_t width = 2 * get_worker_pool().size();
+  parse_benchmark("parallel ordered  ", [width](AsyncGenerator<long> source) {
+    return std::move(source) | parallel_map(parse_record, width);
+  });
+  parse_benchmark("parallel unordered", [width](AsyncGenerator<long> source) {
+    return std::move(source) |
+           parallel_map(parse_record, width, Ordering::Unordered);
+  });
+  return 0;
+}
@@ -0,0 +1,353 @@
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// ==============================================================================
+// Policy-based tasks: choosing coroutine behaviour at compile time
+// ==============================================================================
+// simple-task.cc already passes the co_yield awaiter to Promise<T, Awaiter> as
+// a template parameter. This file applies the same idea to the other knobs a
+// task type has, so each use site can pick its trade-off without paying for a
+// runtime flag on every resume:
+//
+//   Start policy      - LazyStart (suspend_always) or EagerStart (suspend_never)
+//   Final policy      - TransferToContinuation (symmetric transfer back to the
+//                       awaiting coroutine) or SuspendAtEnd (suspend_always;
+//                       the owner inspects the result and destroys the frame)
+//   Allocator policy  - DefaultFrameAllocator (global operator new) or
+//                       PoolFrameAllocator (thread-local free lists)
+//
+// BasicTask<T, Policies...> takes the policies in any order; each policy
+// names its category through a 'policy_tag', and anything not given falls
+// back to the default (lazy, transfer, default allocator).
+
+// ==============================================================================
+// Policy categories
+// ==============================================================================
+struct StartPolicyTag {};
+struct FinalPolicyTag {};
+struct AllocatorPolicyTag {};
+
+// ==============================================================================
+// Start policies: what initial_suspend() returns
+// ==============================================================================
+// LazyStart: The body runs when the task is first awaited (or resumed)
+struct LazyStart {
+  using policy_tag = StartPolicyTag;
+  static constexpr bool eager = false;
+  static std::suspend_always initial_suspend() noexcept { return {}; }
+};
+
+// EagerStart: The body runs immediately, until its first real suspension
+// - co_await on a task that already finished does not suspend at all
+struct EagerStart {
+  using policy_tag = StartPolicyTag;
+  static constexpr bool eager = true;
+  static std::suspend_never initial_suspend() noexcept { return {}; }
+};
+
+// ==============================================================================
+// Final policies: what final_suspend() returns
+// ==============================================================================
+// TransferToContinuation: Resume whoever awaited us (like PreviousAwaiter)
+struct TransferToContinuation {
+  using policy_tag = FinalPolicyTag;
+  static constexpr bool awaitable = true;
+
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> /*finishing*/) noexcept {
+      return continuation;
+    }
+
+    void await_resume() noexcept {}
+
+    std::coroutine_handle<> continuation;
+  };
+
+  static Awaiter final_suspend(std::coroutine_handle<> continuation) noexcept {
+    return Awaiter{continuation};
+  }
+};
+
+// SuspendAtEnd: Just stop; for top-level tasks driven by hand
+// - Nobody is resumed, so such a task cannot be co_await'ed (static_assert)
+struct SuspendAtEnd {
+  using policy_tag = FinalPolicyTag;
+  static constexpr bool awaitable = false;
+
+  static std::suspend_always
+  final_suspend(std::coroutine_handle<> /*continuation*/) noexcept {
+    return {};
+  }
+};
+
+// ==============================================================================
+// Allocator policies: promise-level operator new / operator delete
+// ==============================================================================
+// The promise inherits from the allocator policy, which is how the compiler
+// finds promise_type::operator new for the coroutine frame.
+//
+// DefaultFrameAllocator: Declares nothing, so the global operator new is used
+struct DefaultFrameAllocator {
+  using policy_tag = AllocatorPolicyTag;
+};
+
+// PoolFrameAllocator: Recycles frames through thread-local free lists
+// - Frame sizes are rounded up to 64-byte size classes; frames larger than
+//   the biggest class go to the global operator new
+// - Frames are created and destroyed many times with the same few sizes, so
+//   after warm-up every allocation is a pop from a singly linked list
+// - Freed blocks are kept for the lifetime of the thread
+struct PoolFrameAllocator {
+  using policy_tag = AllocatorPolicyTag;
+
+  static constexpr std::size_t granularity = 64;
+  static constexpr std::size_t size_classes = 16;  // up to 1 KiB frames
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  static void *operator new(std::size_t size) {
+    std::size_t index = size_class(size);
+    if (index >= size_classes) {
+      return ::operator new(size);
+    }
+    if (FreeBlock *block = free_lists[index]) {
+      free_lists[index] = block->next;
+      return block;
+    }
+    return ::operator new((index + 1) * granularity);
+  }
+
+  static void operator delete(void *frame, std::size_t size) {
+    std::size_t index = size_class(size);
+    if (index >= size_classes) {
+      ::operator delete(frame, size);
+      return;
+    }
+    auto *block = static_cast<FreeBlock *>(frame);
+    block->next = free_lists[index];
+    free_lists[index] = block;
+  }
+
+  static std::size_t size_class(std::size_t size) {
+    return (size + granularity - 1) / granularity - 1;
+  }
+
+  static thread_local std::array<FreeBlock *, size_classes> free_lists;
+};
+
+thread_local std::array<PoolFrameAllocator::FreeBlock *,
+                        PoolFrameAllocator::size_classes>
+    PoolFrameAllocator::free_lists{};
+
+// ==============================================================================
+// SelectPolicy: Pick the policy with a given tag out of a parameter pack
+// ==============================================================================
+// SelectPolicy<StartPolicyTag, LazyStart, SuspendAtEnd, EagerStart>::type
+//   -> EagerStart
+// SelectPolicy<AllocatorPolicyTag, DefaultFrameAllocator, EagerStart>::type
+//   -> DefaultFrameAllocator (not given, use the default)
+template <typename Tag, typename Default, typename... Policies>
+struct SelectPolicy {
+  using type = Default;
+};
+
+template <typename Tag, typename Default, typename First, typename... Rest>
+struct SelectPolicy<Tag, Default, First, Rest...>
+    : std::conditional_t<std::is_same_v<typename First::policy_tag, Tag>,
+                         std::type_identity<First>,
+                         SelectPolicy<Tag, Default, Rest...>> {};
+
+template <typename Policy>
+concept TaskPolicy = std::is_same_v<typename Policy::policy_tag, StartPolicyTag> ||
+                     std::is_same_v<typename Policy::policy_tag, FinalPolicyTag> ||
+                     std::is_same_v<typename Policy::policy_tag, AllocatorPolicyTag>;
+
+// ==============================================================================
+// ResultStorage: return_value() / return_void() and the exception slot
+// ==============================================================================
+template <typename T> struct ResultStorage {
+  void return_value(T val) { value = std::move(val); }
+
+  T result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+
+  std::optional<T> value{std::nullopt};
+  std::exception_ptr exception{nullptr};
+};
+
+template <> struct ResultStorage<void> {
+  void return_void() {}
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  std::exception_ptr exception{nullptr};
+};
+
+// ==============================================================================
+// BasicPromise / BasicTask
+// ==============================================================================
+template <typename T, typename Start, typename Final, typename Allocator>
+struct BasicPromise : ResultStorage<T>, Allocator {
+
+  auto initial_suspend() noexcept { return Start::initial_suspend(); }
+
+  auto final_suspend() noexcept { return Final::final_suspend(continuation); }
+
+  void unhandled_exception() { this->exception = std::current_exception(); }
+
+  std::coroutine_handle<BasicPromise> get_return_object() {
+    return std::coroutine_handle<BasicPromise>::from_promise(*this);
+  }
+
+  // continuation: The coroutine awaiting this one (noop until awaited)
+  std::coroutine_handle<> continuation{std::noop_coroutine()};
+};
+
+template <typename T, TaskPolicy... Policies> struct BasicTask {
+  using Start = typename SelectPolicy<StartPolicyTag, LazyStart, Policies...>::type;
+  using Final =
+      typename SelectPolicy<FinalPolicyTag, TransferToContinuation, Policies...>::type;
+  using Allocator = typename SelectPolicy<AllocatorPolicyTag,
+                                          DefaultFrameAllocator, Policies...>::type;
+
+  using promise_type = BasicPromise<T, Start, Final, Allocator>;
+
+  BasicTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  BasicTask(const BasicTask &) = delete;
+  BasicTask &operator=(const BasicTask &) = delete;
+
+  BasicTask(BasicTask &&other) noexcept
+      : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  BasicTask &operator=(BasicTask &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~BasicTask() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  struct Awaiter {
+    // await_ready(): Only an eager task can already be done when awaited
+    bool await_ready() noexcept { return Start::eager && coroutine.done(); }
+
+    // await_suspend(): Lazy - start the callee now (symmetric transfer)
+    //                  Eager - the callee is already running, just wait
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> caller) noexcept {
+      coroutine.promise().continuation = caller;
+      if constexpr (Start::eager) {
+        return std::noop_coroutine();
+      } else {
+        return coroutine;
+      }
+    }
+
+    T await_resume() { return coroutine.promise().result(); }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  Awaiter operator co_await() {
+    static_assert(Final::awaitable,
+                  "a SuspendAtEnd task never resumes its awaiter; drive it "
+                  "with resume() and read result() instead");
+    return Awaiter{coroutine};
+  }
+
+  // resume() / done() / result(): For driving a top-level task by hand
+  void resume() { coroutine.resume(); }
+  bool done() const { return coroutine.done(); }
+  T result() { return coroutine.promise().result(); }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// ==============================================================================
+// Use-site aliases: each hot path picks its own trade-off
+// ==============================================================================
+// LazyTask:        the plain Task<T> of the other examples
+// EagerPooledTask: cache-hit style calls that usually finish synchronously,
+//                  created millions of times, so frames come from the pool
+// RootTask:        a top-level task driven from main()
+template <typename T> using LazyTask = BasicTask<T>;
+template <typename T>
+using EagerPooledTask = BasicTask<T, EagerStart, PoolFrameAllocator>;
+template <typename T> using RootTask = BasicTask<T, SuspendAtEnd>;
+
+static_assert(std::is_same_v<LazyTask<int>::Start, LazyStart>);
+static_assert(std::is_same_v<EagerPooledTask<int>::Final, TransferToContinuation>);
+static_assert(std::is_same_v<RootTask<int>::Allocator, DefaultFrameAllocator>);
+
+// ==============================================================================
+// Demo: the same leaf/sum pair with two policy sets
+// ==============================================================================
+template <typename TaskType> TaskType leaf(int i) { co_return i; }
+
+template <typename TaskType> RootTask<long> sum(int count) {
+  long total = 0;
+  for (int i = 0; i < count; ++i) {
+    total += co_await leaf<TaskType>(i);
+  }
+  co_return total;
+}
+
+// benchmark(): Runs sum() 'rounds' times and reports the cost per co_await
+// - Each root task is kept short because GCC only turns symmetric transfer
+//   into a tail call when optimizing; at -O0 (or with ASan) every transfer
+//   still uses a bit of stack until the root task suspends
+template <typename TaskType>
+void benchmark(const char *name, int rounds, int count) {
+  long total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    RootTask<long> root = sum<TaskType>(count);
+    while (!root.done()) {
+      root.resume();
+    }
+    total += root.result();
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start);
+  std::cout << name << ": total = " << total << ", "
+            << elapsed.count() / (double(rounds) * count) << " ns per co_await"
+            << std::endl;
+}
+
+int main() {
+  constexpr int rounds = 200;
+  constexpr int count = 5'000;
+  benchmark<LazyTask<int>>("LazyTask<int>       ", rounds, count);
+  benchmark<EagerPooledTask<int>>("EagerPooledTask<int>", rounds, count);
+  return 0;
+}
@@ -121,6 +121,26 @@ struct Task {
   // Constructor: Takes ownership of the coroutine handle
   Task(std::coroutine_handle<Promise> handle) : coroutine(handle) {}
 
+  // Copying is DELETED: two Tasks owning one frame would destroy it twice
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  // Moving transfers ownership; the moved-from Task no longer destroys it
+  Task(Task &&other) noexcept : coroutine(other.coroutine) {
+    other.coroutine = nullptr;
+  }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = other.coroutine;
+      other.coroutine = nullptr;
+    }
+    return *this;
+  }
+
   // value(): Retrieves the current value from the promise
   std::optional<int> value() { return coroutine.promise()._value; }
 
@@ -144,6 +164,26 @@ struct WorldTask {
   // Constructor: Takes ownership of the coroutine handle
   WorldTask(std::coroutine_handle<Promise> handle) : coroutine(handle) {}
 
+  // Copying is DELETED: two Tasks owning one frame would destroy it twice
+  WorldTask(const WorldTask &) = delete;
+  WorldTask &operator=(const WorldTask &) = delete;
+
+  // Moving transfers ownership; the moved-from WorldTask no longer destroys it
+  WorldTask(WorldTask &&other) noexcept : coroutine(other.coroutine) {
+    other.coroutine = nullptr;
+  }
+
+  WorldTask &operator=(WorldTask &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = other.coroutine;
+      other.coroutine = nullptr;
+    }
+    return *this;
+  }
+
   // Destructor: Cleans up the coroutine
   ~WorldTask() {
     if (coroutine) {
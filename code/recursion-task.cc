@@ -1,6 +1,10 @@
 #include <coroutine>
 #include <iostream>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 
 struct PreviousAwaiter {
@@ -43,6 +47,10 @@ struct CalleeAwaiter {
 
 struct Promise {
 
+  // Count every coroutine frame, to compare plain and memoized recursion
+  Promise() { ++frames_created; }
+  static inline int frames_created = 0;
+
   auto initial_suspend() { return std::suspend_always{}; }
   
   auto final_suspend() noexcept { return PreviousAwaiter{previous}; }
@@ -78,7 +86,25 @@ struct Task {
 
   Task(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
 
-  Task& operator=(Task&& other) = delete;
+  // Copying is DELETED: two Tasks owning one frame would destroy it twice
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  // Moving transfers ownership; the moved-from Task no longer destroys it
+  Task(Task &&other) noexcept : coroutine(other.coroutine) {
+    other.coroutine = nullptr;
+  }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = other.coroutine;
+      other.coroutine = nullptr;
+    }
+    return *this;
+  }
 
   ~Task() {
     if (coroutine) {
@@ -163,6 +189,96 @@ Task factorial(int n) {
   co_return result;  // This triggers final_suspend() → PreviousAwaiter
 }
 
+// ==============================================================================
+// Memo: Memoized recursive calls for overlapping subproblems
+// ==============================================================================
+// factorial() never asks for the same n twice, but fibonacci(n) asks for
+// fibonacci(n-1) and fibonacci(n-2), and fibonacci(n-1) asks for fibonacci(n-2)
+// again. Written as plain recursive coroutines that is one new frame per call:
+// exponential frame creation.
+//
+// Memo is a per-computation table in front of one recursive coroutine
+// function. Inside that function, recursive calls go through the table:
+//
+//   int a = co_await memo(n - 1);   // instead of co_await fibonacci(n - 1)
+//
+// MemoAwaiter:
+// - await_ready(): the key was computed before -> no frame, no suspension,
+//   the value comes straight from the table
+// - await_suspend(): first request for the key -> create the callee frame and
+//   go DOWN into it exactly like CalleeAwaiter
+// - await_resume(): store the callee's result in the table and destroy its
+//   frame, so the table holds plain values, not finished frames
+//
+// Each key gets one frame, so frame creation is linear in the number of
+// distinct subproblems. A key that is requested again while it is still being
+// computed can only be a cyclic recursion, and is reported as an error.
+struct Memo {
+  using Function = Task (*)(Memo &, int);
+
+  struct MemoAwaiter {
+    bool await_ready() {
+      if (memo.values.contains(key)) {
+        std::cout << "- [Memo] Hit for " << key << ": no new frame." << std::endl;
+        return true;
+      }
+      return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+      if (!memo.in_flight.insert(key).second) {
+        throw std::logic_error("Memo: cyclic recursion on key " +
+                               std::to_string(key));
+      }
+      callee.emplace(memo.function(memo, key));
+      return CalleeAwaiter{callee->coroutine, nullptr}.await_suspend(caller);
+    }
+
+    int await_resume() {
+      if (callee) {
+        memo.values[key] = callee->value().value_or(0);
+        memo.in_flight.erase(key);
+        callee.reset();  // destroys the finished frame
+      }
+      return memo.values[key];
+    }
+
+    Memo &memo;
+    int key;
+    std::optional<Task> callee{};
+  };
+
+  explicit Memo(Function function) : function(function) {}
+
+  MemoAwaiter operator()(int key) { return MemoAwaiter{*this, key}; }
+
+  Function function;
+  std::unordered_map<int, int> values;  // finished subproblems
+  std::unordered_set<int> in_flight;    // keys on the current call chain
+};
+
+// fibonacci(): Plain recursion - one frame per call
+Task fibonacci(int n) {
+  if (n < 2) {
+    co_return n;
+  }
+  Task first = fibonacci(n - 1);
+  int a = co_await first;
+  Task second = fibonacci(n - 2);
+  int b = co_await second;
+  co_return a + b;
+}
+
+// fibonacci_memo(): The same recursion through a Memo - one frame per n
+Task fibonacci_memo(Memo &memo, int n) {
+  if (n < 2) {
+    co_return n;
+  }
+  int a = co_await memo(n - 1);
+  int b = co_await memo(n - 2);  // always a hit: computed by memo(n - 1)
+  co_return a + b;
+}
+
 // ==============================================================================
 // main(): Demonstrates recursive coroutine execution
 // ==============================================================================
@@ -189,5 +305,23 @@ int main() {
   // Retrieve the final result
   std::cout << "\nFinal result: " << *task.value() << std::endl;
 
+  // Overlapping subproblems: plain vs memoized fibonacci(6)
+  std::cout << "\n=== Memoized Recursion ===" << std::endl;
+  Promise::frames_created = 0;
+  Task plain = fibonacci(6);
+  plain.coroutine.resume();
+  int plain_frames = Promise::frames_created;
+
+  Promise::frames_created = 0;
+  Memo memo(fibonacci_memo);
+  Task memoized = fibonacci_memo(memo, 6);
+  memoized.coroutine.resume();
+  int memo_frames = Promise::frames_created;
+
+  std::cout << "\nfibonacci(6) = " << *plain.value() << " using "
+            << plain_frames << " frames" << std::endl;
+  std::cout << "fibonacci_memo(6) = " << *memoized.value() << " using "
+            << memo_frames << " frames" << std::endl;
+
   return 0;
 }
\ No newline at end of file
@@ -1,11 +1,35 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <coroutine>
 #include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <queue>
+#include <source_location>
 #include <span>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef COROUTINE_FRAME_REGISTRY
+#include <csignal>
+#include <ctime>
+#include <cxxabi.h>
+#include <unistd.h>
+#endif
 
 using namespace std::chrono_literals;
 
@@ -21,6 +45,513 @@ concept Awaitable = Awaiter<A> || requires(A a) {
   { a.operator co_await() } -> Awaiter;
 };
 
+// FrameState / WaitReason: What a coroutine frame is doing right now
+// - Only recorded when built with -DCOROUTINE_FRAME_REGISTRY
+// - WaitReason lists every kind of awaiter a frame can be parked on; awaiters
+//   report themselves through PromiseBase::on_suspended()
+enum class FrameState : unsigned char { Created, Running, Suspended, Done };
+enum class WaitReason : unsigned char {
+  None, Task, Timer, Fd, Channel, Mutex, Graph
+};
+
+struct Loop;
+
+// ==============================================================================
+// PromiseBase: The part of every Promise<T> that does not depend on T
+// ==============================================================================
+// Diagnostics such as the Loop watchdog only see type-erased handles, so the
+// information they need lives in a common, non-template base:
+// - previous_promise mirrors 'previous' and lets us walk the async call chain
+//   (the "async backtrace") without knowing the caller's promise type
+// - function_name / frame_address identify the frame in reports
+//
+// With -DCOROUTINE_FRAME_REGISTRY every PromiseBase also links itself into the
+// FrameRegistry (an intrusive list of live frames) and tracks its state and
+// the awaiter it is suspended on. Without the flag those members and hooks
+// compile away to nothing.
+struct PromiseBase {
+  // The default argument is evaluated where the compiler constructs the
+  // promise, so function_name() reports the coroutine function itself.
+  explicit PromiseBase(
+      std::source_location location = std::source_location::current(),
+      const std::type_info &type = typeid(PromiseBase));
+
+  ~PromiseBase();
+
+  PromiseBase(const PromiseBase &) = delete;
+  PromiseBase &operator=(const PromiseBase &) = delete;
+
+  // State hooks, called by the Loop and by the awaiters
+  void on_running() noexcept;
+  void on_suspended(WaitReason reason, const void *object) noexcept;
+  void on_done() noexcept;
+
+  // previous_promise: The caller's promise (nullptr at the top level)
+  // - Set together with 'previous' by Task::Awaiter::await_suspend()
+  // - Atomic because the watchdog thread follows it (relaxed is enough: the
+  //   walk only trusts frames it finds in the FrameRegistry)
+  std::atomic<PromiseBase *> previous_promise{nullptr};
+
+  // function_name: Name of the coroutine function that owns this frame
+  const char *function_name;
+
+  // frame_address: Address of the coroutine frame (handle.address())
+  void *frame_address{nullptr};
+
+  // loop: The Loop this frame runs on, whose current_promise it updates
+  // - Set when a Loop resumes or spawns the frame, and handed from caller to
+  //   callee by Task::Awaiter; nullptr until then (the global Loop is used)
+  Loop *loop{nullptr};
+
+  // owner: The Loop that owns this frame (see Loop::spawn), nullptr unless
+  // detached; a detached frame is destroyed when it finishes
+  Loop *owner{nullptr};
+
+#ifdef COROUTINE_FRAME_REGISTRY
+  // promise_type: The most-derived promise type, e.g. Promise<int>
+  const std::type_info *promise_type;
+
+  // state / wait_reason / wait_object: Read by the dump thread, hence atomic
+  std::atomic<FrameState> state{FrameState::Created};
+  std::atomic<WaitReason> wait_reason{WaitReason::None};
+  std::atomic<const void *> wait_object{nullptr};
+
+  // Intrusive links of the FrameRegistry list (guarded by its mutex)
+  PromiseBase *registry_prev{nullptr};
+  PromiseBase *registry_next{nullptr};
+#endif
+};
+
+#ifdef COROUTINE_FRAME_REGISTRY
+// ==============================================================================
+// FrameRegistry: Every live coroutine frame, for post-mortem style dumps
+// ==============================================================================
+// Frames link themselves in on construction and out on destruction, so the
+// registry costs no allocation. dump() groups the frames by what they wait on,
+// which is what you want to see when 100k frames are parked in a hung process.
+//
+// dump() is meant to run off the Loop thread (see install_frame_dump_signal),
+// so list changes take the mutex and per-frame state is atomic.
+struct FrameRegistry {
+  void link(PromiseBase *frame) {
+    std::lock_guard lock(mutex);
+    frame->registry_next = head;
+    if (head) {
+      head->registry_prev = frame;
+    }
+    head = frame;
+  }
+
+  void unlink(PromiseBase *frame) {
+    std::lock_guard lock(mutex);
+    if (frame->registry_prev) {
+      frame->registry_prev->registry_next = frame->registry_next;
+    } else {
+      head = frame->registry_next;
+    }
+    if (frame->registry_next) {
+      frame->registry_next->registry_prev = frame->registry_prev;
+    }
+  }
+
+  // dump(): Print frames grouped by wait reason, then by function
+  // - Frames that finished but whose Task has not destroyed them yet are not
+  //   live work; they are listed in their own group and counted apart
+  void dump(std::ostream &out) {
+    // group -> (function, promise type) -> count
+    std::map<std::string, std::map<std::string, std::size_t>> groups;
+    std::size_t live = 0;
+    std::size_t done = 0;
+    {
+      std::lock_guard lock(mutex);
+      for (PromiseBase *frame = head; frame; frame = frame->registry_next) {
+        std::string key = std::string(frame->function_name) + "  [" +
+                          demangle(frame->promise_type->name()) + "]";
+        ++groups[group_name(*frame)][key];
+        if (frame->state.load(std::memory_order_relaxed) == FrameState::Done) {
+          ++done;
+        } else {
+          ++live;
+        }
+      }
+    }
+
+    out << "=== " << live << " live coroutine frames, " << done
+        << " done but not destroyed ===" << std::endl;
+    for (auto &[group, functions] : groups) {
+      std::size_t count = 0;
+      for (auto &entry : functions) {
+        count += entry.second;
+      }
+      out << group << ": " << count << std::endl;
+      for (auto &[function, n] : functions) {
+        out << "    " << n << "  " << function << std::endl;
+      }
+    }
+  }
+
+  // backtrace(): Follow previous_promise from 'innermost', calling
+  // visit(frame) for each frame, innermost first
+  // - Runs under the list mutex, and frames unlink under it before their
+  //   memory is freed, so every frame visited stays alive during the walk
+  // - A link to a frame that is not in the list (a stale previous_promise
+  //   of a finished caller) ends the walk, and so does max_depth
+  template <typename F>
+  void backtrace(const std::atomic<PromiseBase *> &innermost, F visit,
+                 std::size_t max_depth = 64) {
+    std::lock_guard lock(mutex);
+    std::unordered_set<const PromiseBase *> live;
+    for (PromiseBase *frame = head; frame; frame = frame->registry_next) {
+      live.insert(frame);
+    }
+    PromiseBase *frame = innermost.load(std::memory_order_acquire);
+    for (std::size_t depth = 0; frame && live.contains(frame) && depth < max_depth;
+         ++depth) {
+      visit(*frame);
+      frame = frame->previous_promise.load(std::memory_order_relaxed);
+    }
+  }
+
+  static FrameRegistry &instance() {
+    static FrameRegistry registry;
+    return registry;
+  }
+
+private:
+  static std::string group_name(const PromiseBase &frame) {
+    switch (frame.state.load(std::memory_order_relaxed)) {
+    case FrameState::Created:
+      return "created (not started)";
+    case FrameState::Running:
+      return "running";
+    case FrameState::Done:
+      return "done (awaiting destroy)";
+    case FrameState::Suspended:
+      break;
+    }
+    switch (frame.wait_reason.load(std::memory_order_relaxed)) {
+    case WaitReason::Task:
+      return "suspended on Task";
+    case WaitReason::Timer:
+      return "suspended on timer";
+    case WaitReason::Fd:
+      return "suspended on fd";
+    case WaitReason::Channel:
+      return "suspended on channel";
+    case WaitReason::Mutex:
+      return "suspended on mutex";
+    case WaitReason::Graph:
+      return "suspended on task graph";
+    case WaitReason::None:
+      break;
+    }
+    return "suspended (unknown awaiter)";
+  }
+
+  static std::string demangle(const char *name) {
+    int status = 0;
+    std::unique_ptr<char, void (*)(void *)> demangled(
+        abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+    return status == 0 ? demangled.get() : name;
+  }
+
+  std::mutex mutex;
+  PromiseBase *head{nullptr};
+};
+
+// install_frame_dump_signal(): Dump the registry to stderr on 'signo'
+// - The handler only writes one byte to a pipe (async-signal-safe)
+// - A dedicated thread reads the pipe and does the dump, so it works even
+//   when the Loop thread is stuck
+// - Usage: kill -USR1 <pid>
+int frame_dump_pipe[2] = {-1, -1};
+
+void install_frame_dump_signal(int signo = SIGUSR1) {
+  if (frame_dump_pipe[0] >= 0 || ::pipe(frame_dump_pipe) != 0) {
+    return;
+  }
+
+  std::thread([] {
+    char byte;
+    while (::read(frame_dump_pipe[0], &byte, 1) > 0) {
+      FrameRegistry::instance().dump(std::cerr);
+    }
+  }).detach();
+
+  struct sigaction action{};
+  action.sa_handler = [](int) {
+    char byte = 0;
+    [[maybe_unused]] auto n = ::write(frame_dump_pipe[1], &byte, 1);
+  };
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  ::sigaction(signo, &action, nullptr);
+}
+#endif
+
+PromiseBase::PromiseBase(std::source_location location,
+                         [[maybe_unused]] const std::type_info &type)
+    : function_name(location.function_name()) {
+#ifdef COROUTINE_FRAME_REGISTRY
+  promise_type = &type;
+  FrameRegistry::instance().link(this);
+#endif
+}
+
+PromiseBase::~PromiseBase() {
+#ifdef COROUTINE_FRAME_REGISTRY
+  FrameRegistry::instance().unlink(this);
+#endif
+}
+
+void PromiseBase::on_running() noexcept {
+#ifdef COROUTINE_FRAME_REGISTRY
+  wait_reason.store(WaitReason::None, std::memory_order_relaxed);
+  wait_object.store(nullptr, std::memory_order_relaxed);
+  state.store(FrameState::Running, std::memory_order_relaxed);
+#endif
+}
+
+void PromiseBase::on_suspended([[maybe_unused]] WaitReason reason,
+                               [[maybe_unused]] const void *object) noexcept {
+#ifdef COROUTINE_FRAME_REGISTRY
+  wait_reason.store(reason, std::memory_order_relaxed);
+  wait_object.store(object, std::memory_order_relaxed);
+  state.store(FrameState::Suspended, std::memory_order_relaxed);
+#endif
+}
+
+void PromiseBase::on_done() noexcept {
+#ifdef COROUTINE_FRAME_REGISTRY
+  state.store(FrameState::Done, std::memory_order_relaxed);
+#endif
+}
+
+// ==============================================================================
+// FrameBudget: Upper bound on the coroutine frame bytes a Loop may hold
+// ==============================================================================
+// Frames are charged when FrameAccounting::operator new allocates them and
+// refunded when they are destroyed. 'current' is the budget that new frames on
+// this thread are charged to; Loop::run() and Loop::spawn() point it at their
+// Loop's budget, so frames created outside a Loop are not limited.
+struct FrameBudget {
+  // try_charge(): Reserve 'bytes', or fail if that would exceed the limit
+  bool try_charge(std::size_t bytes) noexcept {
+    std::size_t current_used = used.load(std::memory_order_relaxed);
+    do {
+      if (limit != 0 && current_used + bytes > limit) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    } while (!used.compare_exchange_weak(current_used, current_used + bytes,
+                                         std::memory_order_relaxed));
+    return true;
+  }
+
+  void refund(std::size_t bytes) noexcept {
+    used.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  // fits(): Whether try_charge(bytes) would succeed right now
+  // - Lets a caller wait for refunds without counting another refusal
+  bool fits(std::size_t bytes) const noexcept {
+    return limit == 0 || used.load(std::memory_order_relaxed) + bytes <= limit;
+  }
+
+  // limit: Maximum bytes of live frames (0 = unlimited)
+  std::size_t limit{0};
+  std::atomic<std::size_t> used{0};
+  std::atomic<std::size_t> rejected{0};
+
+  static thread_local FrameBudget *current;
+
+  // refused_size: Set by FrameAccounting when a budget (not the heap)
+  // refused a frame on this thread: the bytes it asked for. Callers that
+  // care reset it to 0 before creating a frame and read it on failure
+  static thread_local std::size_t refused_size;
+};
+
+thread_local FrameBudget *FrameBudget::current = nullptr;
+thread_local std::size_t FrameBudget::refused_size = 0;
+
+// FrameBudgetScope: Charge frames created in this scope to 'budget'
+struct FrameBudgetScope {
+  explicit FrameBudgetScope(FrameBudget &budget)
+      : saved(std::exchange(FrameBudget::current, &budget)) {}
+  ~FrameBudgetScope() { FrameBudget::current = saved; }
+
+  FrameBudget *saved;
+};
+
+// ==============================================================================
+// FrameAccounting: Promise mixin that tracks coroutine frame memory
+// ==============================================================================
+// The compiler sizes each coroutine frame (locals that live across suspension
+// points, the promise, the awaiters, bookkeeping) and allocates it through
+// promise_type::operator new when one is declared. Mixing FrameAccounting into
+// a promise gives us that size, attributed to the coroutine function:
+//
+//   1. operator new(size) allocates the frame and remembers 'size' in a
+//      thread_local, because it cannot see which function is being called
+//   2. The promise is constructed inside the new frame right afterwards (on
+//      the same thread), with a source_location naming the coroutine
+//      function, and picks the pending size up
+//   3. The destructor gives the bytes back when the frame is destroyed
+//
+// The allocation is also charged to FrameBudget::current. When that fails,
+// operator new returns nullptr and the compiler hands back the
+// promise's get_return_object_on_allocation_failure() instead of a frame:
+// an empty Task, which Loop::spawn() rejects or defers.
+//
+// FrameAccounting::table() keeps per-function counters. Frames still alive
+// when the program exits are reported as leaks: a frame is only freed by
+// handle.destroy(), so a Task that is copied, moved-from or released without
+// destroying its handle shows up here.
+struct FrameAccounting {
+  // FrameStats: Counters for one coroutine function
+  struct FrameStats {
+    std::size_t frame_size{0};  // bytes per frame (same for every call)
+    std::size_t created{0};     // frames ever created
+    std::size_t live{0};        // frames not yet destroyed
+    std::size_t peak_live{0};   // high-water mark of 'live'
+  };
+
+  // Table: FrameStats keyed by coroutine function name
+  // - The leak report runs from its destructor, at static destruction time
+  struct Table {
+    ~Table() { report_leaks(std::cerr); }
+
+    FrameStats *on_created(const char *function, std::size_t size) {
+      std::lock_guard lock(mutex);
+      FrameStats &stats = functions[function];
+      stats.frame_size = size;
+      ++stats.created;
+      stats.peak_live = std::max(stats.peak_live, ++stats.live);
+      live_bytes += size;
+      return &stats;
+    }
+
+    void on_destroyed(FrameStats *stats) {
+      std::lock_guard lock(mutex);
+      --stats->live;
+      live_bytes -= stats->frame_size;
+    }
+
+    // dump(): Per-function frame-size table, biggest frames first
+    void dump(std::ostream &out) {
+      std::lock_guard lock(mutex);
+      std::vector<std::pair<const char *, FrameStats>> rows(functions.begin(),
+                                                           functions.end());
+      std::sort(rows.begin(), rows.end(), [](auto &a, auto &b) {
+        return a.second.frame_size > b.second.frame_size;
+      });
+
+      out << "=== coroutine frame sizes (" << live_bytes
+          << " bytes live) ===" << std::endl;
+      for (auto &[function, stats] : rows) {
+        out << "    " << stats.frame_size << " B  x" << stats.created
+            << " created, " << stats.live << " live, " << stats.peak_live
+            << " peak  " << function << std::endl;
+      }
+    }
+
+    void report_leaks(std::ostream &out) {
+      std::lock_guard lock(mutex);
+      for (auto &[function, stats] : functions) {
+        if (stats.live != 0) {
+          out << "- [FrameAccounting] LEAK: " << stats.live << " frame(s) of "
+              << stats.frame_size << " B never destroyed in " << function
+              << std::endl;
+        }
+      }
+    }
+
+    std::mutex mutex;
+    std::map<const char *, FrameStats> functions;
+    std::size_t live_bytes{0};
+  };
+
+  static Table &table() {
+    static Table instance;
+    return instance;
+  }
+
+  // operator new(): noexcept and may return nullptr, so promises using this
+  // mixin must declare get_return_object_on_allocation_failure()
+  static void *operator new(std::size_t size) noexcept {
+    return allocate_frame(size);
+  }
+
+  // operator delete(): Must release through the same path as operator new
+  static void operator delete(void *frame, [[maybe_unused]] std::size_t size) {
+    free_frame(frame);
+  }
+
+  // allocate_frame() / free_frame(): The frame memory itself
+  // - A nothrow ::operator new is released by the plain ::operator delete,
+  //   never the sized one
+  // - Kept out of the class operators so the compiler does not pair this
+  //   class's operator new with a global delete once both are inlined
+  //   (-Wmismatched-new-delete)
+  static void *allocate_frame(std::size_t size) noexcept {
+    FrameBudget *budget = FrameBudget::current;
+    if (budget && !budget->try_charge(size)) {
+      FrameBudget::refused_size = size;
+      return nullptr;
+    }
+    void *frame = ::operator new(size, std::nothrow);
+    if (!frame) {
+      if (budget) {
+        budget->refund(size);
+      }
+      return nullptr;
+    }
+    pending_frame_size = size;
+    pending_frame_budget = budget;
+    return frame;
+  }
+
+  static void free_frame(void *frame) noexcept { ::operator delete(frame); }
+
+  explicit FrameAccounting(
+      std::source_location location = std::source_location::current())
+      : frame_size(std::exchange(pending_frame_size, 0)),
+        budget(std::exchange(pending_frame_budget, nullptr)),
+        stats(table().on_created(location.function_name(), frame_size)) {}
+
+  ~FrameAccounting() {
+    table().on_destroyed(stats);
+    if (budget) {
+      budget->refund(frame_size);
+    }
+  }
+
+  FrameAccounting(const FrameAccounting &) = delete;
+  FrameAccounting &operator=(const FrameAccounting &) = delete;
+
+  // frame_size: Size the compiler requested for this frame
+  std::size_t frame_size;
+  // budget: Where frame_size was charged (nullptr if outside any Loop)
+  FrameBudget *budget;
+  FrameStats *stats;
+
+  static thread_local std::size_t pending_frame_size;
+  static thread_local FrameBudget *pending_frame_budget;
+};
+
+thread_local std::size_t FrameAccounting::pending_frame_size = 0;
+thread_local FrameBudget *FrameAccounting::pending_frame_budget = nullptr;
+
+// promise_of(): PromiseBase of a handle, or nullptr if the type is unknown
+template <typename P>
+PromiseBase *promise_of(std::coroutine_handle<P> handle) {
+  if constexpr (std::is_base_of_v<PromiseBase, P>) {
+    return &handle.promise();
+  } else {
+    return nullptr;
+  }
+}
+
 struct PreviousAwaiter {
   // await_ready(): Always return false to ensure suspension
   // - This allows await_suspend() to be called to resume the caller
@@ -31,43 +562,47 @@ struct PreviousAwaiter {
   // - Returns the caller's coroutine handle to resume it (symmetric transfer)
   // - This is the "return" mechanism - going back UP the call chain
   // - Must be noexcept because it's used in final_suspend()
+  // - Defined after Loop, because it tells the Loop who is running now
   std::coroutine_handle<>
-  await_suspend(std::coroutine_handle<> coroutine) noexcept {
-    if (previous && !previous.done()) {
-      std::cout
-          << "- [PreviousAwaiter] Climbing up: resuming previous coroutine."
-          << std::endl;
-      // Return the caller's handle - this resumes the caller coroutine
-      // The 'previous' was set by TaskAwaiter when the caller did co_await
-      return previous;
-    } else {
-      std::cout << "- No previous coroutine to resume." << std::endl;
-      // No caller to return to (we're at the top level)
-      return std::noop_coroutine();
-    }
-  }
+  await_suspend(std::coroutine_handle<> coroutine) noexcept;
 
   // await_resume(): Called when resuming, but does nothing for PreviousAwaiter
   // - The caller resumes at its suspension point, not here
   // - Must be noexcept because it's used in final_suspend()
   void await_resume() noexcept {}
 
-  // Constructor: Stores the caller's coroutine handle
-  PreviousAwaiter(std::coroutine_handle<> prev) : previous(prev) {}
+  // Constructor: Stores the caller's coroutine handle and promise
+  PreviousAwaiter(std::coroutine_handle<> prev, PromiseBase *prev_promise,
+                  Loop *owner)
+      : previous(prev), previous_promise(prev_promise), owner(owner) {}
 
   // previous: The coroutine handle of the caller (who is waiting for us)
   // - Set by TaskAwaiter::await_suspend() when caller does co_await
   // - Used to resume the caller when this coroutine completes
   std::coroutine_handle<> previous{std::noop_coroutine()};
+
+  // previous_promise: The caller's promise, used for watchdog bookkeeping
+  PromiseBase *previous_promise{nullptr};
+
+  // owner: Set when nobody awaits this coroutine; it destroys its own frame
+  // and tells this Loop, which may not be the global one
+  Loop *owner{nullptr};
 };
 
-template <typename T> struct Promise {
+template <typename T> struct Promise : PromiseBase, FrameAccounting {
+
+  Promise(std::source_location location = std::source_location::current())
+      : PromiseBase(location, typeid(Promise)), FrameAccounting(location) {}
 
   // initial_suspend(): Always suspend at the start
   auto initial_suspend() { return std::suspend_always{}; }
 
   // final_suspend(): Use PreviousAwaiter to automatically resume caller
-  auto final_suspend() noexcept { return PreviousAwaiter{previous}; }
+  auto final_suspend() noexcept {
+    on_done();
+    return PreviousAwaiter{
+        previous, previous_promise.load(std::memory_order_relaxed), owner};
+  }
 
   // unhandled_exception(): Rethrow any unhandled exceptions
   void unhandled_exception() { exception = std::current_exception(); }
@@ -76,7 +611,16 @@ template <typename T> struct Promise {
 
   // get_return_object(): Creates the Task object for this coroutine
   std::coroutine_handle<Promise> get_return_object() {
-    return std::coroutine_handle<Promise>::from_promise(*this);
+    auto handle = std::coroutine_handle<Promise>::from_promise(*this);
+    frame_address = handle.address();
+    return handle;
+  }
+
+  // get_return_object_on_allocation_failure(): The frame budget said no
+  // - Lets FrameAccounting::operator new return nullptr instead of throwing
+  // - The caller gets an empty Task instead of an exception
+  static std::coroutine_handle<Promise> get_return_object_on_allocation_failure() {
+    return nullptr;
   }
 
   // result retrieval
@@ -95,13 +639,20 @@ template <typename T> struct Promise {
 };
 
 // void return type
-template <> struct Promise<void> {
+template <> struct Promise<void> : PromiseBase, FrameAccounting {
+
+  Promise(std::source_location location = std::source_location::current())
+      : PromiseBase(location, typeid(Promise)), FrameAccounting(location) {}
 
   // initial_suspend(): Always suspend at the start
   auto initial_suspend() { return std::suspend_always{}; }
 
   // final_suspend(): Use PreviousAwaiter to automatically resume caller
-  auto final_suspend() noexcept { return PreviousAwaiter{previous}; }
+  auto final_suspend() noexcept {
+    on_done();
+    return PreviousAwaiter{
+        previous, previous_promise.load(std::memory_order_relaxed), owner};
+  }
 
   // unhandled_exception(): Rethrow any unhandled exceptions
   void unhandled_exception() { exception = std::current_exception(); }
@@ -112,12 +663,23 @@ template <> struct Promise<void> {
     }
   }
 
-  // result retrieval
-  void result() {}
+  // result retrieval: Rethrow what the body threw, like Promise<T>
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  // get_return_object_on_allocation_failure(): The frame budget said no
+  static std::coroutine_handle<Promise> get_return_object_on_allocation_failure() {
+    return nullptr;
+  }
 
   // get_return_object(): Creates the Task object for this coroutine
   std::coroutine_handle<Promise> get_return_object() {
-    return std::coroutine_handle<Promise>::from_promise(*this);
+    auto handle = std::coroutine_handle<Promise>::from_promise(*this);
+    frame_address = handle.address();
+    return handle;
   }
 
   std::coroutine_handle<> previous{std::noop_coroutine()};
@@ -132,23 +694,48 @@ template <typename T = void> struct Task {
 
   Task(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
 
+  // Copying is DELETED: two Tasks owning one frame would destroy it twice
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  // Moving transfers ownership; the moved-from Task no longer destroys it
+  Task(Task &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
   ~Task() {
     if (coroutine) {
       coroutine.destroy();
     }
   }
 
+  // operator bool(): false when the frame budget refused to allocate the frame
+  explicit operator bool() const noexcept { return bool(coroutine); }
+
   struct Awaiter {
-    bool await_ready() noexcept { return false; }
+    // await_ready(): An empty Task never started; await_resume() reports it
+    bool await_ready() noexcept { return !coroutine; }
 
+    // await_suspend(): Link the callee to its caller and transfer into it
+    // - Templated on the caller's promise so the async backtrace can be
+    //   followed through previous_promise
+    // - Defined after Loop, because it tells the Loop who is running now
+    template <typename CallerPromise>
     std::coroutine_handle<>
-    await_suspend(std::coroutine_handle<> caller) noexcept {
-      // Set the caller as the previous coroutine in the callee's promise
-      coroutine.promise().previous = caller;
-      return coroutine;
-    }
+    await_suspend(std::coroutine_handle<CallerPromise> caller) noexcept;
 
     T await_resume() {
+      if (!coroutine) {
+        throw std::bad_alloc();  // rejected by the frame budget
+      }
       if constexpr (std::is_void_v<T>) {
         coroutine.promise().result();
       } else {
@@ -159,10 +746,10 @@ template <typename T = void> struct Task {
     std::coroutine_handle<promise_type> coroutine;
   };
 
-  std::coroutine_handle<> coroutine;
+  // operator co_await(): Makes Task awaitable from another coroutine
+  Awaiter operator co_await() { return Awaiter{coroutine}; }
 
-  // Disable copying to prevent double-destruction
-  Task &operator=(const Task &&) = delete;
+  std::coroutine_handle<promise_type> coroutine;
 };
 
 
@@ -170,26 +757,371 @@ struct Loop {
 
   Loop() = default;
 
+  // ~Loop(): Stop the watchdog before the state it reads goes away
+  ~Loop() { stop_watchdog(); }
+
+  // ReadyEntry: A coroutine waiting to be resumed
+  // - promise is nullptr when the handle was queued type-erased
+  struct ReadyEntry {
+    std::coroutine_handle<> handle;
+    PromiseBase *promise;
+  };
+
   struct TimerEntry {
     std::chrono::steady_clock::time_point expire_time;
     std::coroutine_handle<> handle;
+    PromiseBase *promise;
 
     bool operator>(const TimerEntry &other) const {
       return expire_time > other.expire_time;
     }
   };
 
-  std::queue<std::coroutine_handle<>> ready_tasks;
+  std::queue<ReadyEntry> ready_tasks;
   std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<>> timers;
 
-  void add_task(std::coroutine_handle<> handle) {
-    ready_tasks.push(handle);
+  template <typename P> void add_task(std::coroutine_handle<P> handle) {
+    ready_tasks.push(ReadyEntry{handle, promise_of(handle)});
   }
 
+  template <typename P>
   void add_timer(std::chrono::steady_clock::time_point time,
-                 std::coroutine_handle<> handle) {
-    timers.push(TimerEntry{time, handle});
+                 std::coroutine_handle<P> handle) {
+    timers.push(TimerEntry{time, handle, promise_of(handle)});
+  }
+
+  // ============================================================================
+  // Cross-thread wakeups: expect_post() and post()
+  // ============================================================================
+  // Coroutines run only on the thread calling run(). Work finishing on
+  // another thread (see ThreadPool) hands its coroutine back with post():
+  // - The Loop thread calls expect_post() before the work is handed off, so
+  //   run() keeps waiting while a post is still due even if nothing else is
+  //   queued
+  // - post() is the only thread-safe member; it wakes run() if it is idle
+  void expect_post() {
+    std::lock_guard lock(post_mutex);
+    ++expected_posts;
+  }
+
+  template <typename P> void post(std::coroutine_handle<P> handle) {
+    {
+      std::lock_guard lock(post_mutex);
+      posted_tasks.push_back(ReadyEntry{handle, promise_of(handle)});
+      --expected_posts;
+    }
+    posted.notify_one();
+  }
+
+  // ============================================================================
+  // Admission control: spawn() under the Loop's frame budget
+  // ============================================================================
+  // spawn(make) calls 'make' to create a fire-and-forget Task<> with its frame
+  // charged to frame_budget, and schedules it; the Loop owns the frame from
+  // then on. If the budget is exhausted the frame is never allocated, and
+  // depending on 'admission' the request is:
+  // - Reject: dropped, spawn() returns false (shed load)
+  // - Defer:  queued and retried by run() once finished frames free budget
+  // If the heap itself fails to allocate the frame, spawn() (or run(), for a
+  // deferred spawn) throws std::bad_alloc instead; waiting would not help.
+  //
+  // Frames created inside running tasks (co_await child()) are charged to the
+  // same budget; a refused child is reported by co_await as std::bad_alloc.
+  enum class Admission { Reject, Defer };
+
+  // DeferredSpawn: A spawn the budget refused, and the frame size it asked for
+  struct DeferredSpawn {
+    std::function<Task<>()> make;
+    std::size_t frame_size;
+  };
+
+  FrameBudget frame_budget;
+  Admission admission{Admission::Reject};
+  std::deque<DeferredSpawn> deferred_spawns;
+
+  template <typename F> bool spawn(F make) {
+    if (stopping) {
+      return false;
+    }
+    FrameBudget::refused_size = 0;
+    Task<> task = [&] {
+      FrameBudgetScope scope(frame_budget);
+      return make();
+    }();
+    if (!task) {
+      std::size_t refused = std::exchange(FrameBudget::refused_size, 0);
+      if (refused == 0) {
+        throw std::bad_alloc();  // the heap failed, not the budget
+      }
+      if (admission == Admission::Defer) {
+        deferred_spawns.push_back(DeferredSpawn{std::move(make), refused});
+      }
+      return false;
+    }
+    start_detached(std::move(task));
+    return true;
+  }
+
+  // run(): Resume ready tasks and fire timers until there is nothing left
+  // - Sleeps until the earliest timer when no task is ready
+  // - Deferred spawns still over budget when everything else is finished
+  //   stay queued in deferred_spawns
+  // - Returns early once stop() has been called; finish with drain()
+  void run() {
+    FrameBudgetScope scope(frame_budget);
+    while (!stopping) {
+      admit_deferred();
+      if (!run_once(std::chrono::steady_clock::time_point::max())) {
+        break;
+      }
+    }
+  }
+
+  // ============================================================================
+  // Shutdown: stop() and drain(deadline)
+  // ============================================================================
+  // A rolling deploy wants in-flight work to finish, but not forever:
+  //
+  //   loop.stop();                      // e.g. from a signal-watching task
+  //   loop.run();                       // returns once stopped
+  //   loop.drain(now + 5s);             // finish what we can, then cancel
+  //
+  // stop() refuses new work: spawn() returns false and deferred spawns are
+  // dropped (their frames were never allocated). Already running tasks can
+  // still use add_task()/add_timer() to make progress.
+  //
+  // drain() keeps running ready tasks and timers that fire before the
+  // deadline. Whatever is left at the deadline is cancelled: the queues are
+  // cleared and every spawned frame still in flight is destroyed. Destroying
+  // a frame runs the destructors of its locals, so child Tasks it was
+  // awaiting are destroyed with it. Handles queued with add_task() by their
+  // owner (not spawned) are only dequeued; their owner still destroys them.
+  struct DrainResult {
+    std::size_t completed;  // spawned tasks that finished during drain
+    std::size_t cancelled;  // spawned tasks destroyed at the deadline
+  };
+
+  void stop() {
+    stopping = true;
+    deferred_spawns.clear();
+  }
+
+  DrainResult drain(std::chrono::steady_clock::time_point deadline) {
+    stop();
+    std::size_t in_flight_before = in_flight.size();
+
+    FrameBudgetScope scope(frame_budget);
+    while (std::chrono::steady_clock::now() < deadline && run_once(deadline)) {
+    }
+
+    ready_tasks = {};
+    timers = {};
+    {
+      std::lock_guard lock(post_mutex);
+      posted_tasks.clear();
+    }
+    std::size_t cancelled = in_flight.size();
+    for (void *frame : std::exchange(in_flight, {})) {
+      std::coroutine_handle<>::from_address(frame).destroy();
+    }
+    return DrainResult{in_flight_before - cancelled, cancelled};
+  }
+
+  // on_detached_done(): A spawned task finished and destroys itself
+  void on_detached_done(void *frame) { in_flight.erase(frame); }
+
+  // stopping: Set by stop(); no new work is admitted
+  bool stopping{false};
+
+  // in_flight: Frames owned by the Loop (spawned and not finished yet)
+  std::unordered_set<void *> in_flight;
+
+  // ============================================================================
+  // Watchdog: Flags a single resume() that runs for too long
+  // ============================================================================
+  // Every coroutine on this Loop shares one thread. A coroutine that makes a
+  // blocking call (sleep, read on a blocking fd, a contended std::mutex, ...)
+  // stalls all of them. The watchdog is a separate thread that samples the
+  // Loop a few times per threshold and, when the same resume() has been
+  // running longer than the threshold, reports:
+  // - the frame address of the handle the Loop resumed
+  // - the async backtrace: the innermost running Task and its chain of
+  //   awaiting callers, followed through previous_promise
+  //
+  // The backtrace is read from another thread while the Loop keeps running,
+  // and the stalled resume() may finish and destroy any frame on the chain
+  // at any time. So the walk is only done with -DCOROUTINE_FRAME_REGISTRY:
+  // it runs under the registry mutex (see FrameRegistry::backtrace), which a
+  // frame must take to unlink itself before it is freed, and it only
+  // follows links to frames that are still registered. Without the flag the
+  // report names the stalled frame but does not dereference it.
+  void start_watchdog(std::chrono::milliseconds threshold) {
+    stop_watchdog();
+    // Sample in microseconds, at least every 1ms: in integer milliseconds
+    // threshold / 4 is 0 below 4ms, which would be a busy spin
+    const std::chrono::microseconds period = std::max<std::chrono::microseconds>(
+        std::chrono::microseconds(threshold) / 4, 1ms);
+    watchdog = std::jthread([this, threshold, period](std::stop_token stop) {
+      std::uint64_t reported_sequence = 0;
+      while (!stop.stop_requested()) {
+        std::this_thread::sleep_for(period);
+
+        std::uint64_t sequence = resume_sequence.load(std::memory_order_acquire);
+        void *frame = resuming_frame.load(std::memory_order_acquire);
+        if (frame == nullptr || sequence == reported_sequence) {
+          continue;
+        }
+        auto elapsed = std::chrono::steady_clock::now() -
+                       std::chrono::steady_clock::time_point(
+                           std::chrono::steady_clock::duration(
+                               resume_started.load(std::memory_order_relaxed)));
+        if (elapsed < threshold) {
+          continue;
+        }
+
+        reported_sequence = sequence;
+        report_stall(frame, elapsed);
+      }
+    });
   }
+
+  void stop_watchdog() {
+    if (watchdog.joinable()) {
+      watchdog.request_stop();
+      watchdog.join();
+    }
+  }
+
+  // current_promise: The innermost Task currently running on this Loop
+  // - Updated when the Loop resumes a handle, when a Task is awaited (going
+  //   down) and when it completes (going back up)
+  std::atomic<PromiseBase *> current_promise{nullptr};
+
+private:
+  // admit_deferred(): Spawn deferred work, oldest first, while budget allows
+  // - run() calls this on every iteration; the factory is only called again
+  //   once refunds have made room for the frame it was refused for, so a
+  //   waiting spawn is one refusal, not one per iteration
+  void admit_deferred() {
+    while (!deferred_spawns.empty() &&
+           frame_budget.fits(deferred_spawns.front().frame_size)) {
+      FrameBudget::refused_size = 0;
+      Task<> task = deferred_spawns.front().make();
+      if (!task) {
+        std::size_t refused = std::exchange(FrameBudget::refused_size, 0);
+        if (refused == 0) {
+          deferred_spawns.pop_front();
+          throw std::bad_alloc();  // the heap failed, not the budget
+        }
+        deferred_spawns.front().frame_size = refused;
+        return;
+      }
+      deferred_spawns.pop_front();
+      start_detached(std::move(task));
+    }
+  }
+
+  // start_detached(): Hand the frame over to the Loop and schedule it
+  void start_detached(Task<> task) {
+    task.coroutine.promise().owner = this;
+    task.coroutine.promise().loop = this;
+    in_flight.insert(task.coroutine.address());
+    add_task(std::exchange(task.coroutine, nullptr));
+  }
+
+  // run_once(): Take posted tasks, fire due timers, then resume one task
+  // - With nothing ready, sleeps until the next timer if it is due by
+  //   'limit', or until a post arrives
+  // - Returns false when there is nothing left to do before 'limit'
+  bool run_once(std::chrono::steady_clock::time_point limit) {
+    {
+      std::lock_guard lock(post_mutex);
+      for (ReadyEntry entry : posted_tasks) {
+        ready_tasks.push(entry);
+      }
+      posted_tasks.clear();
+    }
+    auto now = std::chrono::steady_clock::now();
+    while (!timers.empty() && timers.top().expire_time <= now) {
+      ready_tasks.push(ReadyEntry{timers.top().handle, timers.top().promise});
+      timers.pop();
+    }
+
+    if (ready_tasks.empty()) {
+      std::unique_lock lock(post_mutex);
+      auto has_post = [this] { return !posted_tasks.empty(); };
+      if (!timers.empty() && timers.top().expire_time <= limit) {
+        posted.wait_until(lock, timers.top().expire_time, has_post);
+        return true;
+      }
+      if (expected_posts == 0 && !has_post()) {
+        return false;
+      }
+      if (limit == std::chrono::steady_clock::time_point::max()) {
+        posted.wait(lock, has_post);
+      } else {
+        posted.wait_until(lock, limit, has_post);
+      }
+      return true;
+    }
+
+    ReadyEntry entry = ready_tasks.front();
+    ready_tasks.pop();
+    resume(entry);
+    return true;
+  }
+
+  // resume(): Resume one handle with the watchdog bookkeeping around it
+  void resume(ReadyEntry entry) {
+    current_promise.store(entry.promise, std::memory_order_release);
+    if (entry.promise) {
+      entry.promise->loop = this;
+      entry.promise->on_running();
+    }
+    resume_started.store(
+        std::chrono::steady_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed);
+    resuming_frame.store(entry.handle.address(), std::memory_order_release);
+    resume_sequence.fetch_add(1, std::memory_order_release);
+
+    entry.handle.resume();
+
+    resuming_frame.store(nullptr, std::memory_order_release);
+    current_promise.store(nullptr, std::memory_order_release);
+  }
+
+  void report_stall(void *frame, std::chrono::steady_clock::duration elapsed) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+    std::cerr << "- [Watchdog] Loop blocked for " << ms.count()
+              << "ms in resume() of frame " << frame << std::endl;
+
+#ifdef COROUTINE_FRAME_REGISTRY
+    int depth = 0;
+    FrameRegistry::instance().backtrace(
+        current_promise, [&depth](const PromiseBase &promise) {
+          std::cerr << "    #" << depth++ << " " << promise.frame_address
+                    << " in " << promise.function_name << std::endl;
+        });
+    if (depth == 0) {
+      std::cerr << "    (no async backtrace: frame is not a Task)" << std::endl;
+    }
+#else
+    std::cerr << "    (async backtrace needs -DCOROUTINE_FRAME_REGISTRY)"
+              << std::endl;
+#endif
+  }
+
+  // Watchdog state shared with the Loop thread
+  std::atomic<void *> resuming_frame{nullptr};
+  std::atomic<std::chrono::steady_clock::rep> resume_started{0};
+  std::atomic<std::uint64_t> resume_sequence{0};
+  std::jthread watchdog;
+
+  // Cross-thread wakeups, shared with post()
+  std::mutex post_mutex;
+  std::condition_variable posted;
+  std::vector<ReadyEntry> posted_tasks;
+  std::size_t expected_posts{0};
 };
 
 Loop& get_global_loop() {
@@ -197,4 +1129,1190 @@ Loop& get_global_loop() {
   return global_loop;
 }
 
+// loop_of(): The Loop a frame runs on (the global one if not known yet)
+Loop &loop_of(const PromiseBase *promise) {
+  return promise && promise->loop ? *promise->loop : get_global_loop();
+}
+
+// Going back UP: the caller becomes the innermost running Task
+std::coroutine_handle<>
+PreviousAwaiter::await_suspend(std::coroutine_handle<> coroutine) noexcept {
+  // An EagerTask that finishes inline has no caller linked yet; whoever
+  // called it is still the running Task, so only update when there is one
+  if (previous_promise) {
+    loop_of(previous_promise).current_promise.store(previous_promise,
+                                                    std::memory_order_release);
+    previous_promise->on_running();
+  }
+  if (owner) {
+    // Spawned on a Loop: nobody will destroy us, so do it now. Safe because
+    // the coroutine is suspended at its final suspend point.
+    owner->on_detached_done(coroutine.address());
+    coroutine.destroy();
+    return std::noop_coroutine();
+  }
+  if (previous && !previous.done()) {
+    std::cout
+        << "- [PreviousAwaiter] Climbing up: resuming previous coroutine."
+        << std::endl;
+    // Return the caller's handle - this resumes the caller coroutine
+    // The 'previous' was set by TaskAwaiter when the caller did co_await
+    return previous;
+  } else {
+    std::cout << "- No previous coroutine to resume." << std::endl;
+    // No caller to return to (we're at the top level)
+    return std::noop_coroutine();
+  }
+}
+
+// Going DOWN: the callee becomes the innermost running Task
+template <typename T>
+template <typename CallerPromise>
+std::coroutine_handle<> Task<T>::Awaiter::await_suspend(
+    std::coroutine_handle<CallerPromise> caller) noexcept {
+  // Set the caller as the previous coroutine in the callee's promise
+  coroutine.promise().previous = caller;
+  coroutine.promise().previous_promise.store(promise_of(caller),
+                                             std::memory_order_relaxed);
+  if (PromiseBase *caller_promise = promise_of(caller)) {
+    caller_promise->on_suspended(WaitReason::Task, &coroutine.promise());
+    coroutine.promise().loop = caller_promise->loop;
+  }
+  coroutine.promise().on_running();
+  loop_of(&coroutine.promise())
+      .current_promise.store(&coroutine.promise(), std::memory_order_release);
+  return coroutine;
+}
+
+// ==============================================================================
+// SleepAwaiter: Suspends the current coroutine until a point in time
+// ==============================================================================
+// The well-behaved way to wait: the coroutine is parked in the Loop's timer
+// queue and other tasks keep running in the meantime.
+struct SleepAwaiter {
+  std::chrono::steady_clock::time_point expire_time;
+
+  bool await_ready() const noexcept {
+    return std::chrono::steady_clock::now() >= expire_time;
+  }
+
+  template <typename P> void await_suspend(std::coroutine_handle<P> coroutine) {
+    if (PromiseBase *promise = promise_of(coroutine)) {
+      promise->on_suspended(WaitReason::Timer, this);
+    }
+    get_global_loop().add_timer(expire_time, coroutine);
+  }
+
+  void await_resume() noexcept {}
+};
+
+SleepAwaiter sleep_for(std::chrono::steady_clock::duration duration) {
+  return SleepAwaiter{std::chrono::steady_clock::now() + duration};
+}
+
+// ==============================================================================
+// EagerTask: A Task that starts running as soon as it is called
+// ==============================================================================
+// Task<T> is lazy: calling the coroutine only creates the frame, and
+// co_await always suspends the caller and symmetric-transfers into the
+// callee, even when the callee then finishes without ever waiting.
+//
+// EagerTask<T> runs the body immediately (initial_suspend is suspend_never)
+// until it either finishes or really has to wait. By the time the caller
+// writes co_await, the common cache-hit case is already done, so the awaiter
+// takes the synchronous fast path:
+// - await_ready() returns true when the callee has completed
+// - the caller does not suspend, await_resume() hands the result back inline
+// - otherwise await_suspend() just records the caller as the continuation;
+//   the callee is already parked on a timer/fd and resumes the caller from
+//   its final_suspend like Task<T> does. It returns bool: false means "it
+//   finished in the meantime, keep running"
+//
+// Trade-off: the body starts before anyone awaits it, so it must not depend
+// on the caller suspending first, and its exceptions are only seen at
+// co_await.
+template <typename T> struct EagerPromise : Promise<T> {
+
+  EagerPromise(std::source_location location = std::source_location::current())
+      : Promise<T>(location) {}
+
+  // initial_suspend(): Start running right away
+  auto initial_suspend() { return std::suspend_never{}; }
+
+  std::coroutine_handle<EagerPromise> get_return_object() {
+    auto handle = std::coroutine_handle<EagerPromise>::from_promise(*this);
+    this->frame_address = handle.address();
+    return handle;
+  }
+
+  static std::coroutine_handle<EagerPromise>
+  get_return_object_on_allocation_failure() {
+    return nullptr;
+  }
+};
+
+template <typename T = void> struct EagerTask {
+  using promise_type = EagerPromise<T>;
+
+  EagerTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  EagerTask(const EagerTask &) = delete;
+  EagerTask &operator=(const EagerTask &) = delete;
 
+  EagerTask(EagerTask &&other) noexcept
+      : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  EagerTask &operator=(EagerTask &&other) noexcept {
+    if (this != &other) {
+      if (coroutine) {
+        coroutine.destroy();
+      }
+      coroutine = std::exchange(other.coroutine, nullptr);
+    }
+    return *this;
+  }
+
+  ~EagerTask() {
+    if (coroutine) {
+      coroutine.destroy();
+    }
+  }
+
+  struct Awaiter {
+    // await_ready(): The fast path - already finished, don't suspend at all
+    // - An empty EagerTask (refused by the frame budget) is "ready" too;
+    //   await_resume() reports it
+    bool await_ready() noexcept { return !coroutine || coroutine.done(); }
+
+    // await_suspend(): The callee is waiting on something; continue the
+    // caller from the callee's final_suspend once it is done
+    template <typename CallerPromise>
+    bool await_suspend(std::coroutine_handle<CallerPromise> caller) noexcept {
+      coroutine.promise().previous = caller;
+      coroutine.promise().previous_promise.store(promise_of(caller),
+                                                 std::memory_order_relaxed);
+      if (PromiseBase *caller_promise = promise_of(caller)) {
+        caller_promise->on_suspended(WaitReason::Task, &coroutine.promise());
+        coroutine.promise().loop = caller_promise->loop;
+      }
+      return !coroutine.done();
+    }
+
+    T await_resume() {
+      if (!coroutine) {
+        throw std::bad_alloc();  // rejected by the frame budget
+      }
+      if constexpr (std::is_void_v<T>) {
+        coroutine.promise().result();
+      } else {
+        return *(coroutine.promise().result());
+      }
+    }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  Awaiter operator co_await() { return Awaiter{coroutine}; }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// ==============================================================================
+// SharedTask: A task that any number of coroutines can co_await
+// ==============================================================================
+// Task<T> has a single 'previous' slot, so exactly one coroutine may await it.
+// SharedTask<T> is for results that many callers want at the same time (a
+// config or auth lookup): the body runs once, and every awaiter, early or
+// late, gets the same cached result.
+//
+// Ownership: SharedTask is a reference-counted handle; copies share the frame,
+// which is destroyed when the last copy goes away.
+//
+// Waiters: Each co_await links a node that lives inside its Awaiter (i.e. in
+// the awaiting coroutine's frame, no allocation) into an intrusive list. The
+// list head is a single atomic pointer with three kinds of values:
+//   not_started()  - nobody awaited yet; the first awaiter starts the body
+//   started()      - running, no waiters yet (also the list terminator)
+//   done()         - finished; awaiters take the result without suspending
+//   anything else  - the most recent Waiter, linked through 'next'
+// Pushing is a CAS loop, completion is one exchange(done()), so awaiters on
+// other threads never take a lock. When the body finishes, the waiters are
+// resumed in the order they arrived; the last one by symmetric transfer.
+template <typename T> struct SharedPromise : PromiseBase, FrameAccounting {
+
+  // Waiter: One suspended awaiter, embedded in SharedTask::Awaiter
+  struct Waiter {
+    std::coroutine_handle<> continuation;
+    PromiseBase *promise;
+    Waiter *next;
+  };
+
+  SharedPromise(std::source_location location = std::source_location::current())
+      : PromiseBase(location, typeid(SharedPromise)), FrameAccounting(location) {}
+
+  // initial_suspend(): Lazy; the first awaiter starts the body
+  auto initial_suspend() { return std::suspend_always{}; }
+
+  // FinalAwaiter: Publish the result and resume every waiter
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<SharedPromise> finished) noexcept {
+      SharedPromise &promise = finished.promise();
+      void *list = promise.state.exchange(done(), std::memory_order_acq_rel);
+
+      // The list is newest-first; reverse it so waiters resume in FIFO order
+      Waiter *oldest = nullptr;
+      for (auto *waiter = static_cast<Waiter *>(list); waiter != started();) {
+        Waiter *next = waiter->next;
+        waiter->next = oldest;
+        oldest = waiter;
+        waiter = next;
+      }
+
+      while (oldest && oldest->next) {
+        Waiter *waiter = oldest;
+        oldest = oldest->next;
+        if (waiter->promise) {
+          waiter->promise->on_running();
+        }
+        waiter->continuation.resume();
+      }
+      if (oldest) {
+        if (oldest->promise) {
+          oldest->promise->on_running();
+        }
+        return oldest->continuation;
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  auto final_suspend() noexcept {
+    on_done();
+    return FinalAwaiter{};
+  }
+
+  void unhandled_exception() { exception = std::current_exception(); }
+
+  template <typename U> void return_value(U &&val) {
+    value.emplace(std::forward<U>(val));
+  }
+
+  std::coroutine_handle<SharedPromise> get_return_object() {
+    auto handle = std::coroutine_handle<SharedPromise>::from_promise(*this);
+    frame_address = handle.address();
+    return handle;
+  }
+
+  static std::coroutine_handle<SharedPromise>
+  get_return_object_on_allocation_failure() {
+    return nullptr;
+  }
+
+  const T &result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return *value;
+  }
+
+  // Sentinel values of 'state' (never valid Waiter addresses)
+  void *not_started() noexcept { return this; }
+  static Waiter *started() noexcept { return nullptr; }
+  static void *done() noexcept {
+    static char sentinel;
+    return &sentinel;
+  }
+
+  std::atomic<void *> state{not_started()};
+  std::atomic<std::size_t> references{1};
+  std::exception_ptr exception{nullptr};
+  std::optional<T> value{std::nullopt};
+};
+
+template <typename T> struct SharedTask {
+  using promise_type = SharedPromise<T>;
+
+  SharedTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+
+  // Copies share the frame; the last one destroys it
+  SharedTask(const SharedTask &other) noexcept : coroutine(other.coroutine) {
+    if (coroutine) {
+      coroutine.promise().references.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  SharedTask(SharedTask &&other) noexcept
+      : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+  SharedTask &operator=(SharedTask other) noexcept {
+    std::swap(coroutine, other.coroutine);
+    return *this;
+  }
+
+  ~SharedTask() {
+    if (coroutine && coroutine.promise().references.fetch_sub(
+                         1, std::memory_order_acq_rel) == 1) {
+      coroutine.destroy();
+    }
+  }
+
+  explicit operator bool() const noexcept { return bool(coroutine); }
+
+  struct Awaiter {
+    // await_ready(): Already finished - take the cached result inline
+    bool await_ready() noexcept {
+      return !coroutine || coroutine.promise().state.load(
+                               std::memory_order_acquire) == promise_type::done();
+    }
+
+    // await_suspend(): Push ourselves onto the waiter list
+    // - First awaiter: start the body by transferring into it
+    // - Finished in the meantime: resume ourselves right away
+    template <typename CallerPromise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<CallerPromise> caller) noexcept {
+      promise_type &promise = coroutine.promise();
+      waiter.continuation = caller;
+      waiter.promise = promise_of(caller);
+
+      void *old_state = promise.state.load(std::memory_order_acquire);
+      do {
+        if (old_state == promise_type::done()) {
+          return caller;
+        }
+        waiter.next = old_state == promise.not_started()
+                          ? promise_type::started()
+                          : static_cast<typename promise_type::Waiter *>(old_state);
+      } while (!promise.state.compare_exchange_weak(
+          old_state, &waiter, std::memory_order_acq_rel,
+          std::memory_order_acquire));
+
+      if (waiter.promise) {
+        waiter.promise->on_suspended(WaitReason::Task, &promise);
+      }
+      if (old_state == promise.not_started()) {
+        // For the async backtrace, the starter counts as the caller
+        promise.previous_promise.store(waiter.promise,
+                                       std::memory_order_relaxed);
+        promise.loop = waiter.promise ? waiter.promise->loop : nullptr;
+        promise.on_running();
+        return coroutine;
+      }
+      return std::noop_coroutine();
+    }
+
+    const T &await_resume() {
+      if (!coroutine) {
+        throw std::bad_alloc();  // rejected by the frame budget
+      }
+      return coroutine.promise().result();
+    }
+
+    std::coroutine_handle<promise_type> coroutine;
+    typename promise_type::Waiter waiter{};
+  };
+
+  Awaiter operator co_await() const { return Awaiter{coroutine}; }
+
+  std::coroutine_handle<promise_type> coroutine;
+};
+
+// ==============================================================================
+// AsyncCache: Single-flight cache of SharedTasks with TTL eviction
+// ==============================================================================
+// co_await cache.get(key, loader) returns the cached value for 'key', or
+// starts loader(key) (any coroutine whose co_await yields T) to produce it.
+//
+// Single flight: The entry is a SharedTask, inserted *before* the load runs,
+// so concurrent gets for the same key all await the one in-flight load. This
+// is what prevents a stampede of identical backend calls after a restart.
+//
+// TTL: Once a load succeeds, the entry expires 'ttl' later. A small eviction
+// coroutine is spawned on the Loop and sleeps on a Loop timer for that long;
+// get() also treats expired entries as misses in case the Loop is stopped.
+// When the Loop refuses that spawn (frame budget, stop()), the entry is
+// marked untimed instead, and get() sweeps the expired entries out of the
+// map while any are left. Failed loads are removed immediately, so the next
+// get() retries.
+//
+// Single Loop: The cache belongs to the global Loop. get(), the loads and
+// the evictions all run on the Loop thread, which is also what spawn(), the
+// timers and the frame budget require, so the map needs no lock. A program
+// with one Loop per worker thread gives each worker its own cache (which is
+// the sharding: no two workers ever share a map); calling get() from
+// another thread is a data race.
+//
+// Lifetime: The map lives in a shared State. Loads and evictions only hold
+// a weak_ptr to it, so destroying the cache with work in flight is safe.
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+struct AsyncCache {
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    SharedTask<T> task;
+    Clock::time_point expires;  // time_point::max() while loading
+    std::uint64_t generation;   // tells a refreshed entry from the old one
+    bool untimed{false};        // no eviction coroutine; swept by get()
+  };
+
+  using Entries = std::unordered_map<Key, Entry, Hash>;
+
+  struct State {
+    explicit State(Clock::duration ttl) : ttl(ttl) {}
+
+    // erase(): Remove an entry, keeping 'untimed' in step
+    void erase(typename Entries::iterator it) {
+      if (it->second.untimed) {
+        --untimed;
+      }
+      entries.erase(it);
+    }
+
+    // sweep(): Drop every expired entry (only needed when some are untimed)
+    void sweep(Clock::time_point now) {
+      for (auto it = entries.begin(); it != entries.end();) {
+        auto current = it++;
+        if (current->second.expires <= now) {
+          erase(current);
+        }
+      }
+    }
+
+    Clock::duration ttl;
+    Entries entries;
+    std::size_t untimed{0};  // entries whose eviction spawn was refused
+    std::uint64_t next_generation{0};
+    std::size_t hits{0};
+    std::size_t loads{0};
+  };
+
+  explicit AsyncCache(Clock::duration ttl)
+      : state(std::make_shared<State>(ttl)) {}
+
+  // get(): The cached/in-flight SharedTask for 'key', loading it on a miss
+  // - Loop thread only (see "Single Loop" above)
+  template <typename Loader> SharedTask<T> get(const Key &key, Loader loader) {
+    auto now = Clock::now();
+    if (state->untimed != 0) {
+      state->sweep(now);
+    }
+
+    auto it = state->entries.find(key);
+    if (it != state->entries.end() && it->second.expires > now) {
+      ++state->hits;
+      return it->second.task;
+    }
+    if (it != state->entries.end()) {
+      state->erase(it);
+    }
+
+    // Miss (or expired): the load is lazy and starts with the first awaiter
+    ++state->loads;
+    std::uint64_t generation = ++state->next_generation;
+    SharedTask<T> task = load(state, key, generation, std::move(loader));
+    state->entries.emplace(key,
+                           Entry{task, Clock::time_point::max(), generation});
+    return task;
+  }
+
+  std::size_t hits() const { return state->hits; }
+  std::size_t loads() const { return state->loads; }
+
+private:
+  template <typename Loader>
+  static SharedTask<T> load(std::weak_ptr<State> weak_state, Key key,
+                            std::uint64_t generation, Loader loader) {
+    std::optional<T> value;
+    std::exception_ptr error;
+    try {
+      value.emplace(co_await loader(key));
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    if (auto state = weak_state.lock()) {
+      loaded(*state, weak_state, key, generation, error == nullptr);
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    co_return std::move(*value);
+  }
+
+  // loaded(): Start the TTL on success, forget the entry on failure
+  static void loaded(State &state, std::weak_ptr<State> weak_state,
+                     const Key &key, std::uint64_t generation, bool ok) {
+    auto it = state.entries.find(key);
+    if (it == state.entries.end() || it->second.generation != generation) {
+      return;
+    }
+    if (!ok) {
+      state.erase(it);
+      return;
+    }
+    it->second.expires = Clock::now() + state.ttl;
+
+    bool scheduled =
+        get_global_loop().spawn([weak_state, key, generation, ttl = state.ttl] {
+          return evict_after(weak_state, key, generation, ttl);
+        });
+    if (!scheduled) {
+      // No timer will evict this entry: leave it to the sweep in get().
+      // spawn() does not run the task, so 'it' is still valid
+      it->second.untimed = true;
+      ++state.untimed;
+    }
+  }
+
+  static Task<> evict_after(std::weak_ptr<State> weak_state, Key key,
+                            std::uint64_t generation, Clock::duration ttl) {
+    co_await sleep_for(ttl);
+    if (auto state = weak_state.lock()) {
+      auto it = state->entries.find(key);
+      if (it != state->entries.end() && it->second.generation == generation) {
+        state->erase(it);
+      }
+    }
+  }
+
+  std::shared_ptr<State> state;
+};
+
+// ==============================================================================
+// ThreadPool: Worker threads for CPU-bound TaskGraph nodes
+// ==============================================================================
+struct ThreadPool {
+  explicit ThreadPool(std::size_t threads) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  // ~ThreadPool(): Finishes the queued jobs, then joins the workers
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+  }
+
+  std::size_t size() const { return workers.size(); }
+
+private:
+  void work() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::deque<std::function<void()>> jobs;
+  bool stopping{false};
+  std::vector<std::thread> workers;
+};
+
+ThreadPool &get_worker_pool() {
+  static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+// ==============================================================================
+// TaskGraph: Runs a DAG of nodes as soon as their inputs are ready
+// ==============================================================================
+// Build and ETL pipelines are dependency graphs. Written as nested co_awaits
+// they run one step at a time, even where two branches are independent:
+//
+//   co_await extract_orders();   // 30ms
+//   co_await extract_users();    // 20ms that could have overlapped
+//
+// TaskGraph takes the nodes and their dependencies up front instead:
+//
+//   TaskGraph graph;
+//   auto orders = graph.add("orders", [] { return extract_orders(); });
+//   auto users = graph.add("users", [] { return extract_users(); });
+//   auto stats = graph.add_cpu("stats", [] { compute_stats(); }, {orders});
+//   graph.add("join", [] { return join_tables(); }, {stats, users});
+//   co_await graph.run();
+//
+// Two kinds of node:
+// - add(): A coroutine on the Loop. Ready branches are in flight together
+//   and overlap their timer and I/O waits.
+// - add_cpu(): A plain function on the worker pool (get_worker_pool()).
+//   Ready CPU nodes run on different cores at the same time, and never block
+//   the Loop thread.
+// Either way the pipeline takes about as long as its critical path instead
+// of the sum of its nodes.
+//
+// Scheduling: Each node has an atomic in-degree counter, the number of its
+// dependencies that have not finished yet. run() schedules every node
+// without dependencies; a finishing node decrements the counters of its
+// dependents, on whichever thread it finished, and schedules each one that
+// reaches 0. A CPU node is submitted to the pool right there, so a chain of
+// CPU nodes never round-trips through the Loop. A coroutine node is post()ed
+// to the Loop. An atomic count of unfinished nodes is the completion latch:
+// the node that takes it to 0 posts run() back to the Loop.
+//
+// Acyclic by construction: add() only accepts dependencies on nodes that
+// were added before, so every graph is a DAG in insertion order.
+//
+// Errors: A node that throws (or whose frame the budget refused) fails, and
+// every node downstream of it is skipped without running. Independent
+// branches still run to completion, then run() rethrows the first error.
+//
+// Data flows between nodes through state the caller owns, captured by the
+// node factories; the graph only decides when each node runs. Finishing a
+// node happens-before its dependents start, so a node may read what its
+// dependencies wrote without further locking.
+struct TaskGraph {
+  using NodeId = std::size_t;
+
+  enum class NodeStatus { Pending, Succeeded, Failed, Skipped };
+
+  struct Node {
+    std::string name;
+    std::function<Task<>()> make;  // add(): a coroutine on the Loop
+    std::function<void()> work;    // add_cpu(): a function on the pool
+    std::vector<NodeId> dependents;
+    std::size_t dependency_count{0};
+
+    // Per run()
+    std::atomic<std::size_t> remaining{0};  // dependencies not finished yet
+    std::atomic<bool> input_failed{false};  // a dependency failed/skipped
+    NodeStatus status{NodeStatus::Pending};
+    std::optional<Task<>> runner;  // the run_node() frame, owned here
+  };
+
+  TaskGraph() = default;
+
+  // Nodes and workers hold 'this'; the graph must stay put while it runs
+  TaskGraph(const TaskGraph &) = delete;
+  TaskGraph &operator=(const TaskGraph &) = delete;
+
+  // add(): A node that runs make() once all of 'dependencies' have succeeded
+  NodeId add(std::string name, std::function<Task<>()> make,
+             std::initializer_list<NodeId> dependencies = {}) {
+    NodeId id = add_node(std::move(name), dependencies);
+    nodes[id].make = std::move(make);
+    return id;
+  }
+
+  // add_cpu(): A node that runs work() on the worker pool
+  NodeId add_cpu(std::string name, std::function<void()> work,
+                 std::initializer_list<NodeId> dependencies = {}) {
+    NodeId id = add_node(std::move(name), dependencies);
+    nodes[id].work = std::move(work);
+    return id;
+  }
+
+  // run(): Runs every node once; may be awaited again after it finished
+  // - Must be awaited from a Task<> running on the global Loop
+  Task<> run() {
+    first_error = nullptr;
+    for (Node &node : nodes) {
+      node.remaining.store(node.dependency_count, std::memory_order_relaxed);
+      node.input_failed.store(false, std::memory_order_relaxed);
+      node.status = NodeStatus::Pending;
+      node.runner.reset();
+    }
+    unfinished.store(nodes.size(), std::memory_order_relaxed);
+
+    co_await AllFinished{this};
+    if (first_error) {
+      std::rethrow_exception(first_error);
+    }
+  }
+
+  const Node &node(NodeId id) const { return nodes.at(id); }
+  std::size_t size() const { return nodes.size(); }
+
+private:
+  NodeId add_node(std::string name, std::initializer_list<NodeId> dependencies) {
+    NodeId id = nodes.size();
+    for (NodeId dependency : dependencies) {
+      if (dependency >= id) {
+        throw std::invalid_argument("TaskGraph::add: unknown dependency of " +
+                                    name);
+      }
+    }
+    Node &node = nodes.emplace_back();
+    node.name = std::move(name);
+    for (NodeId dependency : dependencies) {
+      nodes[dependency].dependents.push_back(id);
+      ++node.dependency_count;
+    }
+    return id;
+  }
+
+  // AllFinished: Starts the roots, then parks run() until the last node has
+  // finished
+  // - Everything the workers need (waiter, runners, expected posts) is set
+  //   up on the Loop thread before the first node starts
+  struct AllFinished {
+    bool await_ready() const noexcept { return graph->nodes.empty(); }
+
+    void await_suspend(std::coroutine_handle<Promise<void>> caller) {
+      caller.promise().on_suspended(WaitReason::Graph, graph);
+      graph->waiter = caller;
+      graph->start();
+    }
+
+    void await_resume() const noexcept {}
+
+    TaskGraph *graph;
+  };
+
+  // start(): Create the coroutine nodes' frames, then schedule the roots
+  // - Frames are created here, on the Loop thread and under its frame
+  //   budget; a worker that releases a coroutine node only posts it
+  // - Every runner is posted exactly once (skipped nodes too), and so is the
+  //   waiter, so their expect_post()s all balance
+  void start() {
+    Loop &loop = get_global_loop();
+    loop.expect_post();  // the waiter
+    for (NodeId id = 0; id < nodes.size(); ++id) {
+      Node &node = nodes[id];
+      if (node.make) {
+        node.runner.emplace(run_node(id));
+        if (*node.runner) {
+          loop.expect_post();
+        }
+      }
+    }
+    for (NodeId id = 0; id < nodes.size(); ++id) {
+      if (nodes[id].dependency_count == 0) {
+        schedule(id);
+      }
+    }
+  }
+
+  // schedule(): All inputs are in; start the node where it runs
+  // - Called on the Loop thread for roots, on any thread after that
+  void schedule(NodeId id) {
+    Node &node = nodes[id];
+    if (node.work) {
+      if (node.input_failed.load(std::memory_order_relaxed)) {
+        finished(id, NodeStatus::Skipped);
+        return;
+      }
+      get_worker_pool().submit([this, id] { run_cpu_node(id); });
+      return;
+    }
+    if (!*node.runner) {
+      // The frame budget refused the runner
+      record_error(std::make_exception_ptr(std::bad_alloc()));
+      finished(id, NodeStatus::Failed);
+      return;
+    }
+    get_global_loop().post(node.runner->coroutine);
+  }
+
+  void run_cpu_node(NodeId id) {
+    NodeStatus status = NodeStatus::Succeeded;
+    try {
+      nodes[id].work();
+    } catch (...) {
+      record_error(std::current_exception());
+      status = NodeStatus::Failed;
+    }
+    finished(id, status);
+  }
+
+  Task<> run_node(NodeId id) {
+    Node &node = nodes[id];  // stable: a deque only grows in add()
+    NodeStatus status = NodeStatus::Skipped;
+    if (!node.input_failed.load(std::memory_order_relaxed)) {
+      try {
+        co_await node.make();
+        status = NodeStatus::Succeeded;
+      } catch (...) {
+        record_error(std::current_exception());
+        status = NodeStatus::Failed;
+      }
+    }
+    finished(id, status);
+  }
+
+  // finished(): Release the dependents; wake run() after the last node
+  // - The acq_rel decrements order this node's work before its dependents
+  //   (and run()) start
+  // - Nothing may touch 'this' after the last decrement of 'unfinished':
+  //   run() may resume and destroy the graph as soon as it is posted
+  void finished(NodeId id, NodeStatus status) {
+    nodes[id].status = status;
+    for (NodeId dependent : nodes[id].dependents) {
+      Node &next = nodes[dependent];
+      if (status != NodeStatus::Succeeded) {
+        next.input_failed.store(true, std::memory_order_relaxed);
+      }
+      if (next.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        schedule(dependent);
+      }
+    }
+    std::coroutine_handle<Promise<void>> to_wake = waiter;
+    if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      get_global_loop().post(to_wake);
+    }
+  }
+
+  void record_error(std::exception_ptr error) {
+    std::lock_guard lock(error_mutex);
+    if (!first_error) {
+      first_error = error;
+    }
+  }
+
+  std::deque<Node> nodes;  // a deque: Nodes hold atomics and never move
+  std::atomic<std::size_t> unfinished{0};
+  std::mutex error_mutex;
+  std::exception_ptr first_error{nullptr};
+  std::coroutine_handle<Promise<void>> waiter{nullptr};
+};
+
+// ==============================================================================
+// Demo coroutines
+// ==============================================================================
+// ticker(): Cooperates with the Loop by awaiting timers
+Task<> ticker() {
+  for (int i = 0; i < 3; ++i) {
+    co_await sleep_for(50ms);
+    std::cout << "tick " << i << std::endl;
+  }
+}
+
+// blocking_lookup(): BUG on purpose - a blocking call inside a coroutine
+// - std::this_thread::sleep_for() blocks the Loop thread, so ticker() stalls
+Task<int> blocking_lookup() {
+  std::this_thread::sleep_for(300ms);
+  co_return 42;
+}
+
+Task<int> handle_request() {
+  int value = co_await blocking_lookup();
+  co_return value + 1;
+}
+
+#ifdef COROUTINE_FRAME_REGISTRY
+// dump_frames(): Print the registry from inside the Loop
+// - Queued behind ticker() and handle_request(), so it runs while ticker() is
+//   parked on its timer and the finished handle_request() frame is still
+//   owned by its Task
+Task<> dump_frames() {
+  FrameRegistry::instance().dump(std::cout);
+  co_return;
+}
+#endif
+
+// job(): A spawned unit of work holding its frame across one timer wait
+Task<> job(int id, std::chrono::milliseconds delay = 10ms) {
+  co_await sleep_for(delay);
+  std::cout << "job " << id << " done" << std::endl;
+}
+
+// cached_lookup(): Usually a cache hit, occasionally has to wait
+// - Hits complete during the call, so co_await on them never suspends
+EagerTask<int> cached_lookup(int key) {
+  static std::map<int, int> cache;
+  if (auto it = cache.find(key); it != cache.end()) {
+    co_return it->second;
+  }
+  co_await sleep_for(10ms);  // simulated miss: fetch from the backend
+  cache[key] = key * 10;
+  co_return key * 10;
+}
+
+Task<> lookups() {
+  for (int key : {1, 1, 2, 1, 2}) {
+    EagerTask<int> lookup = cached_lookup(key);
+    bool inline_hit = lookup.coroutine.done();
+    int value = co_await lookup;
+    std::cout << "lookup(" << key << ") = " << value
+              << (inline_hit ? "  (completed inline)" : "  (suspended)")
+              << std::endl;
+  }
+}
+
+// load_config(): Expensive, and every handler needs it
+SharedTask<std::string> load_config() {
+  std::cout << "loading config (runs once)" << std::endl;
+  co_await sleep_for(30ms);
+  co_return std::string("max_connections=1024");
+}
+
+Task<> handler(int id, SharedTask<std::string> config) {
+  const std::string &value = co_await config;
+  std::cout << "handler " << id << " got " << value << std::endl;
+}
+
+// fetch_user(): A slow backend call, loaded through the cache
+Task<std::string> fetch_user(int id) {
+  std::cout << "backend: fetching user " << id << std::endl;
+  co_await sleep_for(20ms);
+  co_return "user-" + std::to_string(id);
+}
+
+Task<> serve(int request, AsyncCache<int, std::string> &cache, int user) {
+  const std::string &name =
+      co_await cache.get(user, [](int id) { return fetch_user(id); });
+  std::cout << "request " << request << ": " << name << std::endl;
+}
+
+// etl_step(): A pipeline stage that mostly waits on I/O
+Task<> etl_step(std::string name, std::chrono::milliseconds duration,
+                std::chrono::steady_clock::time_point start, bool fail = false) {
+  co_await sleep_for(duration);
+  auto at = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  if (fail) {
+    std::cout << "[+" << at.count() << "ms] " << name << " failed" << std::endl;
+    throw std::runtime_error(name + ": source unavailable");
+  }
+  std::cout << "[+" << at.count() << "ms] " << name << " done" << std::endl;
+}
+
+// build_pipeline(): Three extracts feeding a join, then two sinks
+// - Sequential co_awaits would take 30+20+25+10+15+10+5 = 115ms; the critical
+//   path (orders -> clean -> enrich -> warehouse) is 65ms
+void build_pipeline(TaskGraph &graph, std::chrono::steady_clock::time_point start,
+                    bool users_fail) {
+  auto step = [start](const char *name, std::chrono::milliseconds duration,
+                      bool fail = false) {
+    return [=] { return etl_step(name, duration, start, fail); };
+  };
+  auto orders = graph.add("extract orders", step("extract orders", 30ms));
+  auto users =
+      graph.add("extract users", step("extract users", 20ms, users_fail));
+  auto prices = graph.add("extract prices", step("extract prices", 25ms));
+  auto clean = graph.add("clean orders", step("clean orders", 10ms), {orders});
+  auto enrich = graph.add("enrich", step("enrich", 15ms), {clean, users, prices});
+  graph.add("load warehouse", step("load warehouse", 10ms), {enrich});
+  graph.add("report", step("report", 5ms), {enrich});
+}
+
+// checksum_shard(): CPU-bound work, like hashing one shard of a file
+std::uint64_t checksum_shard(std::uint64_t seed, std::size_t rounds) {
+  std::uint64_t hash = seed;
+  for (std::size_t i = 0; i < rounds; ++i) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash += i;
+  }
+  return hash;
+}
+
+// CpuTimes: CPU time each node spent working, one slot per node
+// - Each node writes only its own slot; run() finishing orders the writes
+//   before the reads in main()
+using CpuTimes = std::vector<std::chrono::nanoseconds>;
+
+// thread_cpu_time(): CPU time of the calling thread (not wall time, which
+// would also count time the thread spent preempted)
+std::chrono::nanoseconds thread_cpu_time() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+}
+
+// build_checksums(): Four independent shards feeding a combine step
+void build_checksums(TaskGraph &graph, std::vector<std::uint64_t> &sums,
+                     CpuTimes &times) {
+  auto timed = [&times](std::size_t slot, std::function<void()> work) {
+    return [&times, slot, work = std::move(work)] {
+      auto start = thread_cpu_time();
+      work();
+      times[slot] = thread_cpu_time() - start;
+    };
+  };
+  sums.assign(5, 0);
+  times.assign(5, {});
+  std::vector<TaskGraph::NodeId> shards;
+  for (std::size_t shard = 0; shard < 4; ++shard) {
+    shards.push_back(graph.add_cpu(
+        "shard " + std::to_string(shard), timed(shard, [&sums, shard] {
+          sums[shard] = checksum_shard(shard + 1, 20'000'000);
+        })));
+  }
+  graph.add_cpu("combine", timed(4, [&sums] {
+                  sums[4] = sums[0] ^ sums[1] ^ sums[2] ^ sums[3];
+                }),
+                {shards[0], shards[1], shards[2], shards[3]});
+}
+
+Task<> run_pipeline(TaskGraph &graph) {
+  try {
+    co_await graph.run();
+    std::cout << "pipeline succeeded" << std::endl;
+  } catch (const std::exception &error) {
+    std::cout << "pipeline failed: " << error.what() << std::endl;
+  }
+}
+
+// stop_after(): Simulates a deploy asking the Loop to shut down
+// - A free function rather than a coroutine lambda: spawn() does not keep the
+//   lambda alive, and a lambda coroutine's captures live in the lambda
+Task<> stop_after(Loop &loop, std::chrono::milliseconds delay) {
+  co_await sleep_for(delay);
+  std::cout << "stop requested" << std::endl;
+  loop.stop();
+}
+
+int main() {
+  Loop &loop = get_global_loop();
+  loop.start_watchdog(100ms);
+#ifdef COROUTINE_FRAME_REGISTRY
+  // Try: kill -USR1 <pid> while the demo runs
+  install_frame_dump_signal();
+#endif
+
+  Task<> tick = ticker();
+  Task<int> request = handle_request();
+  loop.add_task(tick.coroutine);
+  loop.add_task(request.coroutine);
+#ifdef COROUTINE_FRAME_REGISTRY
+  Task<> dump = dump_frames();
+  loop.add_task(dump.coroutine);
+#endif
+  loop.run();
+
+  std::cout << "\nrequest result: " << *request.coroutine.promise().result()
+            << std::endl;
+  FrameAccounting::table().dump(std::cout);
+
+  // Synchronous completion: cache hits never suspend the caller
+  std::cout << "\n=== Eager tasks ===" << std::endl;
+  Task<> lookup_demo = lookups();
+  loop.add_task(lookup_demo.coroutine);
+  loop.run();
+
+  // Shared tasks: one config load, many awaiters
+  std::cout << "\n=== Shared task ===" << std::endl;
+  {
+    SharedTask<std::string> config = load_config();
+    for (int id = 0; id < 3; ++id) {
+      loop.spawn([id, config] { return handler(id, config); });
+    }
+    loop.run();
+    loop.spawn([config] { return handler(3, config); });  // late: inline
+    loop.run();
+  }
+
+  // Single-flight cache: four concurrent requests, one backend call; after
+  // the 50ms TTL the entry is evicted and the next request reloads it
+  std::cout << "\n=== Async cache ===" << std::endl;
+  {
+    AsyncCache<int, std::string> users(50ms);
+    for (int request = 0; request < 4; ++request) {
+      loop.spawn([request, &users] { return serve(request, users, 7); });
+    }
+    loop.run();
+    loop.spawn([&users] { return serve(4, users, 7); });
+    loop.run();
+    std::cout << "hits: " << users.hits() << ", loads: " << users.loads()
+              << std::endl;
+  }
+
+  // Dependency graph: independent branches overlap on the Loop
+  std::cout << "\n=== Task graph ===" << std::endl;
+  for (bool users_fail : {false, true}) {
+    auto start = std::chrono::steady_clock::now();
+    TaskGraph graph;
+    build_pipeline(graph, start, users_fail);
+    Task<> pipeline = run_pipeline(graph);
+    loop.add_task(pipeline.coroutine);
+    loop.run();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "elapsed " << elapsed.count() << "ms;";
+    for (std::size_t id = 0; id < graph.size(); ++id) {
+      if (graph.node(id).status == TaskGraph::NodeStatus::Skipped) {
+        std::cout << " skipped '" << graph.node(id).name << "'";
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  // CPU-bound nodes run on the worker pool, in parallel with each other:
+  // elapsed is about a quarter of the node times with 4+ cores (the same
+  // with one core, where the workers can only take turns)
+  {
+    auto start = std::chrono::steady_clock::now();
+    TaskGraph graph;
+    std::vector<std::uint64_t> sums;
+    CpuTimes times;
+    build_checksums(graph, sums, times);
+    Task<> pipeline = run_pipeline(graph);
+    loop.add_task(pipeline.coroutine);
+    loop.run();
+    auto to_ms = [](std::chrono::steady_clock::duration duration) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+          .count();
+    };
+    std::chrono::nanoseconds busy{};
+    for (auto time : times) {
+      busy += time;
+    }
+    std::cout << "checksum " << std::hex << sums[4] << std::dec << ": elapsed "
+              << to_ms(std::chrono::steady_clock::now() - start)
+              << "ms, sum of node times " << to_ms(busy) << "ms ("
+              << get_worker_pool().size() << " workers on "
+              << std::thread::hardware_concurrency() << " cores)" << std::endl;
+  }
+
+  // Admission control: room for about two job() frames at a time
+  std::cout << "\n=== Frame budget ===" << std::endl;
+  loop.frame_budget.limit = 400;
+  loop.admission = Loop::Admission::Defer;
+  for (int id = 0; id < 5; ++id) {
+    bool admitted = loop.spawn([id] { return job(id); });
+    std::cout << "spawn job " << id << (admitted ? ": admitted" : ": deferred")
+              << std::endl;
+  }
+  loop.run();
+  std::cout << "refused frame allocations: " << loop.frame_budget.rejected
+            << ", bytes still charged: " << loop.frame_budget.used << std::endl;
+
+  // Graceful shutdown: stop after 20ms, then give in-flight work 100ms
+  std::cout << "\n=== Shutdown ===" << std::endl;
+  loop.frame_budget.limit = 0;
+  loop.spawn([] { return job(10, 5ms); });
+  loop.spawn([] { return job(11, 60ms); });
+  loop.spawn([] { return job(12, 1s); });
+  loop.spawn([&loop] { return stop_after(loop, 20ms); });
+  loop.run();
+
+  bool admitted = loop.spawn([] { return job(13); });
+  std::cout << "spawn after stop: " << (admitted ? "admitted" : "refused")
+            << std::endl;
+  auto result = loop.drain(std::chrono::steady_clock::now() + 100ms);
+  std::cout << "drain: " << result.completed << " completed, "
+            << result.cancelled << " cancelled, bytes still charged: "
+            << loop.frame_budget.used << std::endl;
+  return 0;
+}